@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "computesample.h"
+
+// Moving average crossover sweeps. Every pair reads the same prefix sum of the
+// closes, so each average is a subtraction instead of a window sum, and the same
+// per bar returns. Pairs are split over threads, each one only writes its summary.
+
+typedef struct SweepShared
+{
+    const double* prefix; // prefix[i] is the sum of the first i closes
+    const double* returns; // returns[i] is the simple return of bar i, returns[0] is 0
+    size_t count;
+} SweepShared;
+
+typedef struct SweepWorker
+{
+    pthread_t thread;
+    const SweepShared* shared;
+    const BacktestPair* pairs;
+    BacktestSummary* summaries;
+    uint32_t begin;
+    uint32_t end;
+} SweepWorker;
+
+static BacktestSummary RunPair(const SweepShared* shared, BacktestPair pair)
+{
+    const double* prefix = shared->prefix;
+    double inverseFast = 1.0 / pair.fast;
+    double inverseSlow = 1.0 / pair.slow;
+    BacktestSummary summary = {0};
+    double sum = 0;
+    double sumOfSquares = 0;
+    double peak = 0;
+    int position = 0;
+
+    // The position taken at the close of bar t earns the return of bar t + 1.
+    for (size_t t = pair.slow - 1; t + 1 < shared->count; ++t)
+    {
+        double fast = (prefix[t + 1] - prefix[t + 1 - pair.fast]) * inverseFast;
+        double slow = (prefix[t + 1] - prefix[t + 1 - pair.slow]) * inverseSlow;
+        int signal = fast > slow ? 1 : (fast < slow ? -1 : position);
+        if (signal != position)
+        {
+            ++summary.trades;
+            position = signal;
+        }
+        double gain = position * shared->returns[t + 1];
+        sum += gain;
+        sumOfSquares += gain * gain;
+        peak = sum > peak ? sum : peak;
+        summary.maxDrawdown = peak - sum > summary.maxDrawdown ? peak - sum : summary.maxDrawdown;
+    }
+    summary.bars = shared->count - pair.slow;
+
+    summary.pnl = sum;
+    if (summary.bars > 1)
+    {
+        double mean = sum / summary.bars;
+        double variance = (sumOfSquares - sum * mean) / (summary.bars - 1);
+        summary.sharpe = variance > 0 ? mean / sqrt(variance) : 0;
+    }
+    return summary;
+}
+
+static void* SweepWorkerMain(void* argument)
+{
+    SweepWorker* worker = (SweepWorker*)argument;
+    for (uint32_t i = worker->begin; i < worker->end; ++i)
+        worker->summaries[i] = RunPair(worker->shared, worker->pairs[i]);
+    return NULL;
+}
+
+int RunCrossoverSweep(const Candlestick* kline, size_t kline_elements_count, const BacktestPair* pairs, uint32_t pair_count,
+                      BacktestSummary* summaries, const ComputeOptions* options, ComputeStats* stats)
+{
+    if (kline == NULL || pairs == NULL || summaries == NULL || kline_elements_count < 2 || pair_count == 0)
+        return 1;
+    for (uint32_t i = 0; i < pair_count; ++i)
+    {
+        if (pairs[i].fast == 0 || pairs[i].fast >= pairs[i].slow || pairs[i].slow >= kline_elements_count)
+            return 1;
+    }
+    uint32_t threadCount = options != NULL ? options->threadCount : 0;
+    if (threadCount == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = online > 0 ? (uint32_t)online : 1;
+    }
+    if (threadCount > pair_count)
+        threadCount = pair_count;
+
+    double start = ComputeTimestampMs();
+    // Doubles keep the prefix differences exact enough over millions of closes.
+    double* prefix = (double*)malloc((kline_elements_count + 1) * sizeof(double));
+    double* returns = (double*)malloc(kline_elements_count * sizeof(double));
+    SweepWorker* workers = (SweepWorker*)calloc(threadCount, sizeof(SweepWorker));
+    if (prefix == NULL || returns == NULL || workers == NULL)
+    {
+        free(prefix);
+        free(returns);
+        free(workers);
+        return 1;
+    }
+    prefix[0] = 0;
+    returns[0] = 0;
+    for (size_t i = 0; i < kline_elements_count; ++i)
+    {
+        prefix[i + 1] = prefix[i] + kline[i].close;
+        if (i > 0)
+            returns[i] = kline[i - 1].close != 0 ? (double)kline[i].close / kline[i - 1].close - 1.0 : 0;
+    }
+    SweepShared shared = { .prefix = prefix, .returns = returns, .count = kline_elements_count };
+
+    // Every pair walks the same bars, so equal chunks of pairs are equal amounts of work.
+    uint32_t chunk = (pair_count + threadCount - 1) / threadCount;
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        workers[t] = (SweepWorker){
+            .shared = &shared,
+            .pairs = pairs,
+            .summaries = summaries,
+            .begin = t * chunk < pair_count ? t * chunk : pair_count,
+            .end = (t + 1) * chunk < pair_count ? (t + 1) * chunk : pair_count
+        };
+    }
+    // The calling thread takes the first chunk itself.
+    uint32_t started = 0;
+    for (uint32_t t = 1; t < threadCount; ++t)
+    {
+        if (pthread_create(&workers[t].thread, NULL, SweepWorkerMain, &workers[t]) != 0)
+            break;
+        started = t;
+    }
+    SweepWorkerMain(&workers[0]);
+    for (uint32_t t = 1; t <= started; ++t)
+        pthread_join(workers[t].thread, NULL);
+    // Any chunk whose thread failed to start is finished here.
+    for (uint32_t t = started + 1; t < threadCount; ++t)
+        SweepWorkerMain(&workers[t]);
+
+    free(workers);
+    free(returns);
+    free(prefix);
+    if (stats != NULL)
+        *stats = (ComputeStats){ .computeMs = ComputeTimestampMs() - start };
+    return 0;
+}
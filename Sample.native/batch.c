@@ -0,0 +1,749 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "computesample.h"
+
+// Offline batch driver, recomputes the indicators of a whole archive of candle files.
+//
+// Usage: computesample-batch --output-dir DIR [--periods 14,50] [--timeframes 1,5,60]
+//                            [--format binary|csv] [--backend vulkan|scalar|simd|threaded]
+//                            [--device n] [--precision fp32|fp16] [--io-threads 4] [--prefetch 16]
+//                            [--chunk-candles 65536] PATH...
+//
+// Every PATH is a candle file or a directory whose regular files are all taken.
+// Files ending in .csv hold High, Low, Open and Close columns under a header, like
+// the uploads of the web sample; any other file holds raw Candlestick records, like
+// sample.dat. Each file gets one output per timeframe and period, named
+// <file name>.sma<period>[.tf<timeframe>].bin or .csv: the SMA as raw floats, or as
+// an SMA column like the downloads of the web sample. The outputs all go to one
+// directory, so two inputs with the same file name are refused before anything runs.
+//
+// I/O threads read and parse the files ahead of the computation into a bounded queue
+// and a writer thread stores the outputs, so the device only waits on disk when the
+// reads cannot keep up; the report printed at the end shows it as inputWaitMs. Each
+// period gets a ComputeStream opened once for the whole run, so the device, buffers
+// and pipelines are set up once per period however many files and timeframes there
+// are. Every file and timeframe is resampled on the host, then pushed through the
+// stream of each period in chunks of --chunk-candles candles after a reset.
+
+#define MAX_LIST_ENTRIES 16
+#define BATCH_PATH_LENGTH 4096
+#define MAX_IO_THREADS 64 // Reading is bound by the disk long before that
+
+typedef enum OutputFormat
+{
+    OUTPUT_BINARY,
+    OUTPUT_CSV
+} OutputFormat;
+
+typedef struct BatchConfig
+{
+    uint32_t periods[MAX_LIST_ENTRIES];
+    uint32_t periodCount;
+    uint32_t timeframes[MAX_LIST_ENTRIES];
+    uint32_t timeframeCount;
+    OutputFormat format;
+    ComputeOptions options;
+    uint32_t ioThreads;
+    uint32_t prefetch;
+    uint32_t chunkCandles;
+    const char* outputDirectory;
+} BatchConfig;
+
+// Bounded FIFO of pointers shared by the pipeline threads. Pop returns NULL once the
+// queue is closed and drained.
+typedef struct Queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    void** items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closed;
+} Queue;
+
+typedef struct BatchInput
+{
+    const char* path;
+    Candlestick* candles;
+    size_t count;
+} BatchInput;
+
+typedef struct BatchOutput
+{
+    char path[BATCH_PATH_LENGTH];
+    float* values;
+    size_t count;
+} BatchOutput;
+
+typedef struct Pipeline
+{
+    const BatchConfig* config;
+    char** paths;
+    size_t pathCount;
+    Queue ready; // BatchInput, read and parsed
+    Queue written; // BatchOutput, waiting for the writer
+
+    pthread_mutex_t lock; // Guards everything below
+    size_t nextPath;
+    uint32_t activeReaders;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint32_t failedFiles;
+    uint32_t failedOutputs;
+    double readMs; // Summed over the I/O threads
+    double writeMs;
+} Pipeline;
+
+static const char* BackendNames[] = { "vulkan", "scalar", "simd", "threaded" };
+static const char* PrecisionNames[] = { "fp32", "fp16" };
+
+static uint32_t ParseList(const char* text, uint32_t* values)
+{
+    uint32_t count = 0;
+    while (*text != '\0' && count < MAX_LIST_ENTRIES)
+    {
+        char* end = NULL;
+        double value = strtod(text, &end);
+        if (end == text)
+            break;
+        if (value >= 1)
+            values[count++] = (uint32_t)value;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+// Returns the index of the first input path in argv, 0 on a usage error.
+static int ParseArguments(int argc, char** argv, BatchConfig* config)
+{
+    *config = (BatchConfig){
+        .periods = { SMA_DEFAULT_PERIOD },
+        .periodCount = 1,
+        .timeframes = { 1 },
+        .timeframeCount = 1,
+        .format = OUTPUT_BINARY,
+        .ioThreads = 4,
+        .prefetch = 16,
+        .chunkCandles = 65536
+    };
+
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i += 2)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return 0;
+        if (strcmp(argv[i], "--output-dir") == 0)
+            config->outputDirectory = value;
+        else if (strcmp(argv[i], "--periods") == 0)
+            config->periodCount = ParseList(value, config->periods);
+        else if (strcmp(argv[i], "--timeframes") == 0)
+            config->timeframeCount = ParseList(value, config->timeframes);
+        else if (strcmp(argv[i], "--format") == 0 && (strcmp(value, "binary") == 0 || strcmp(value, "csv") == 0))
+            config->format = strcmp(value, "csv") == 0 ? OUTPUT_CSV : OUTPUT_BINARY;
+        else if (strcmp(argv[i], "--backend") == 0)
+        {
+            config->options.backend = -1;
+            for (int b = 0; b <= COMPUTE_BACKEND_CPU_THREADED; ++b)
+            {
+                if (strcmp(value, BackendNames[b]) == 0)
+                    config->options.backend = b;
+            }
+            if (config->options.backend < 0)
+                return 0;
+        }
+        else if (strcmp(argv[i], "--device") == 0)
+            config->options.deviceIndex = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--precision") == 0)
+            config->options.storagePrecision = strcmp(value, "fp16") == 0 ? COMPUTE_PRECISION_FP16 : COMPUTE_PRECISION_FP32;
+        else if (strcmp(argv[i], "--io-threads") == 0)
+            config->ioThreads = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--prefetch") == 0)
+            config->prefetch = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--chunk-candles") == 0)
+            config->chunkCandles = (uint32_t)strtod(value, NULL);
+        else
+            return 0;
+    }
+    if (config->ioThreads == 0)
+        config->ioThreads = 1;
+    if (config->ioThreads > MAX_IO_THREADS)
+        config->ioThreads = MAX_IO_THREADS;
+    if (config->prefetch == 0)
+        config->prefetch = 1;
+    if (config->chunkCandles == 0)
+        config->chunkCandles = 1;
+    if (i >= argc || config->outputDirectory == NULL || config->periodCount == 0 || config->timeframeCount == 0)
+        return 0;
+    return i;
+}
+
+static bool QueueInitialize(Queue* queue, size_t capacity)
+{
+    *queue = (Queue){ .capacity = capacity };
+    queue->items = (void**)malloc(capacity * sizeof(void*));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue->items != NULL;
+}
+
+static void QueueDestroy(Queue* queue)
+{
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
+
+// Blocks while the queue is full.
+static void QueuePush(Queue* queue, void* item)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity)
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    queue->items[(queue->head + queue->count++) % queue->capacity] = item;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Blocks while the queue is empty, unless wait is false.
+static void* QueuePop(Queue* queue, bool wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (wait && queue->count == 0 && !queue->closed)
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    void* item = NULL;
+    if (queue->count > 0)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        --queue->count;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+static void QueueClose(Queue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void* ReadWholeFile(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    char* data = NULL;
+    long length = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (length = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        data = (char*)malloc((size_t)length + 1);
+        if (data != NULL && fread(data, 1, (size_t)length, fp) != (size_t)length)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+    if (data == NULL)
+        return NULL;
+    data[length] = '\0'; // Lets the CSV files be parsed in place
+    *size = (size_t)length;
+    return data;
+}
+
+static bool HasSuffix(const char* text, const char* suffix)
+{
+    size_t length = strlen(text);
+    size_t suffixLength = strlen(suffix);
+    return length >= suffixLength && strcasecmp(text + length - suffixLength, suffix) == 0;
+}
+
+// Index of the header field named name, -1 when missing. Quotes and spaces around it are ignored.
+static int HeaderColumn(const char* header, const char* name)
+{
+    size_t nameLength = strlen(name);
+    int column = 0;
+    for (const char* field = header; ; ++column)
+    {
+        while (*field == ' ' || *field == '"')
+            ++field;
+        const char* end = field;
+        while (*end != ',' && *end != '\n' && *end != '\r' && *end != '\0')
+            ++end;
+        const char* last = end;
+        while (last > field && (last[-1] == ' ' || last[-1] == '"'))
+            --last;
+        if ((size_t)(last - field) == nameLength && strncasecmp(field, name, nameLength) == 0)
+            return column;
+        if (*end != ',')
+            return -1;
+        field = end + 1;
+    }
+}
+
+// Parses the High, Low, Open and Close columns of every line after the header.
+static Candlestick* ParseCsv(char* text, size_t length, size_t* count)
+{
+    int columns[4] = { HeaderColumn(text, "open"), HeaderColumn(text, "high"), HeaderColumn(text, "low"), HeaderColumn(text, "close") };
+    for (int c = 0; c < 4; ++c)
+    {
+        if (columns[c] < 0)
+            return NULL;
+    }
+    // A candle takes at least 8 bytes of text, which bounds their number.
+    Candlestick* candles = (Candlestick*)malloc((length / 8 + 1) * sizeof(Candlestick));
+    if (candles == NULL)
+        return NULL;
+    size_t parsed = 0;
+    char* line = strchr(text, '\n');
+    while (line != NULL && *++line != '\0')
+    {
+        if (*line == '\n' || *line == '\r')
+        {
+            line = strchr(line, '\n');
+            continue;
+        }
+        float values[4];
+        int found = 0;
+        char* field = line;
+        for (int column = 0; ; ++column)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                if (columns[c] != column)
+                    continue;
+                char* end = NULL;
+                values[c] = strtof(field + (*field == '"'), &end);
+                if (end == field + (*field == '"'))
+                {
+                    free(candles);
+                    return NULL;
+                }
+                ++found;
+            }
+            field += strcspn(field, ",\n");
+            if (*field != ',')
+                break;
+            ++field;
+        }
+        if (found != 4)
+        {
+            free(candles);
+            return NULL;
+        }
+        candles[parsed++] = (Candlestick){ .open = values[0], .high = values[1], .low = values[2], .close = values[3] };
+        line = *field == '\n' ? field : NULL;
+    }
+    *count = parsed;
+    return candles;
+}
+
+static bool LoadInput(BatchInput* input, uint64_t* bytes)
+{
+    size_t size = 0;
+    char* data = (char*)ReadWholeFile(input->path, &size);
+    if (data == NULL)
+        return false;
+    *bytes = size;
+    if (HasSuffix(input->path, ".csv"))
+    {
+        input->candles = ParseCsv(data, size, &input->count);
+        free(data);
+    }
+    else
+    {
+        input->candles = (Candlestick*)data;
+        input->count = size / sizeof(Candlestick);
+        if (size % sizeof(Candlestick) != 0)
+        {
+            free(data);
+            input->candles = NULL;
+        }
+    }
+    return input->candles != NULL && input->count > 0;
+}
+
+static void* ReaderMain(void* argument)
+{
+    Pipeline* pipeline = (Pipeline*)argument;
+    for (;;)
+    {
+        pthread_mutex_lock(&pipeline->lock);
+        size_t index = pipeline->nextPath++;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (index >= pipeline->pathCount)
+            break;
+
+        double start = ComputeTimestampMs();
+        BatchInput* input = (BatchInput*)calloc(1, sizeof(BatchInput));
+        uint64_t bytes = 0;
+        bool loaded = input != NULL && (input->path = pipeline->paths[index], LoadInput(input, &bytes));
+        double elapsed = ComputeTimestampMs() - start;
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->readMs += elapsed;
+        pipeline->bytesRead += bytes;
+        pipeline->failedFiles += loaded ? 0 : 1;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (!loaded)
+        {
+            fprintf(stderr, "skipping %s: not a readable candle file\n", pipeline->paths[index]);
+            if (input != NULL)
+                free(input->candles);
+            free(input);
+            continue;
+        }
+        QueuePush(&pipeline->ready, input);
+    }
+
+    // The last reader out tells the computation that no more input is coming.
+    pthread_mutex_lock(&pipeline->lock);
+    bool last = --pipeline->activeReaders == 0;
+    pthread_mutex_unlock(&pipeline->lock);
+    if (last)
+        QueueClose(&pipeline->ready);
+    return NULL;
+}
+
+static bool WriteOutput(const BatchOutput* output, OutputFormat format, uint64_t* bytes)
+{
+    FILE* fp = fopen(output->path, "wb");
+    if (fp == NULL)
+        return false;
+    bool written;
+    if (format == OUTPUT_BINARY)
+        written = fwrite(output->values, sizeof(float), output->count, fp) == output->count;
+    else
+    {
+        written = fputs("SMA\n", fp) >= 0;
+        for (size_t i = 0; i < output->count && written; ++i)
+            written = fprintf(fp, "%.9g\n", output->values[i]) > 0;
+    }
+    long length = ftell(fp);
+    *bytes = length > 0 ? (uint64_t)length : 0;
+    return fclose(fp) == 0 && written;
+}
+
+static void* WriterMain(void* argument)
+{
+    Pipeline* pipeline = (Pipeline*)argument;
+    BatchOutput* output;
+    while ((output = (BatchOutput*)QueuePop(&pipeline->written, true)) != NULL)
+    {
+        double start = ComputeTimestampMs();
+        uint64_t bytes = 0;
+        bool written = WriteOutput(output, pipeline->config->format, &bytes);
+        if (!written)
+            fprintf(stderr, "could not write %s: %s\n", output->path, strerror(errno));
+        double elapsed = ComputeTimestampMs() - start;
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->writeMs += elapsed;
+        pipeline->bytesWritten += bytes;
+        pipeline->failedOutputs += written ? 0 : 1;
+        pthread_mutex_unlock(&pipeline->lock);
+        free(output->values);
+        free(output);
+    }
+    return NULL;
+}
+
+static const char* FileName(const char* path)
+{
+    return strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+}
+
+// <directory>/<file name>.sma<period>[.tf<timeframe>].<bin|csv>, the extension of the
+// input is kept so that a.csv and a.dat do not share their outputs.
+static void OutputPath(const BatchConfig* config, const char* input, uint32_t period, uint32_t timeframe, char* path, size_t length)
+{
+    char suffix[32] = "";
+    if (timeframe != 1)
+        snprintf(suffix, sizeof(suffix), ".tf%u", timeframe);
+    snprintf(path, length, "%s/%s.sma%u%s.%s", config->outputDirectory, FileName(input), period, suffix,
+             config->format == OUTPUT_CSV ? "csv" : "bin");
+}
+
+static int CompareStrings(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int CompareFileNames(const void* a, const void* b)
+{
+    return strcmp(FileName(*(char* const*)a), FileName(*(char* const*)b));
+}
+
+// Inputs from different directories sharing a file name would overwrite each other's outputs.
+static bool HasDuplicateFileNames(char** paths, size_t count)
+{
+    char** sorted = (char**)malloc(count * sizeof(char*));
+    if (sorted == NULL)
+        return true;
+    memcpy(sorted, paths, count * sizeof(char*));
+    qsort(sorted, count, sizeof(char*), CompareFileNames);
+    bool duplicate = false;
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (strcmp(FileName(sorted[i - 1]), FileName(sorted[i])) == 0)
+        {
+            fprintf(stderr, "%s and %s would write the same outputs\n", sorted[i - 1], sorted[i]);
+            duplicate = true;
+        }
+    }
+    free(sorted);
+    return duplicate;
+}
+
+// Expands the arguments into the list of input files, directories giving their regular files by name.
+static char** CollectPaths(char** arguments, int count, size_t* pathCount)
+{
+    size_t capacity = 64;
+    size_t collected = 0;
+    char** paths = (char**)malloc(capacity * sizeof(char*));
+    for (int a = 0; a < count && paths != NULL; ++a)
+    {
+        struct stat status;
+        if (stat(arguments[a], &status) != 0)
+        {
+            fprintf(stderr, "skipping %s: %s\n", arguments[a], strerror(errno));
+            continue;
+        }
+        DIR* directory = S_ISDIR(status.st_mode) ? opendir(arguments[a]) : NULL;
+        size_t first = collected;
+        for (struct dirent* entry = NULL; ; )
+        {
+            char path[BATCH_PATH_LENGTH];
+            if (directory == NULL)
+                snprintf(path, sizeof(path), "%s", arguments[a]);
+            else if ((entry = readdir(directory)) == NULL)
+                break;
+            else if (entry->d_name[0] == '.' ||
+                     snprintf(path, sizeof(path), "%s/%s", arguments[a], entry->d_name) >= (int)sizeof(path) ||
+                     stat(path, &status) != 0 || !S_ISREG(status.st_mode))
+                continue;
+            if (collected == capacity)
+            {
+                char** grown = (char**)realloc(paths, (capacity *= 2) * sizeof(char*));
+                if (grown == NULL)
+                    break;
+                paths = grown;
+            }
+            paths[collected++] = strdup(path);
+            if (directory == NULL)
+                break;
+        }
+        if (directory != NULL)
+        {
+            closedir(directory);
+            qsort(paths + first, collected - first, sizeof(char*), CompareStrings);
+        }
+    }
+    *pathCount = collected;
+    return paths;
+}
+
+typedef struct BatchTotals
+{
+    uint64_t files;
+    uint64_t candles;
+    uint64_t jobs; // Series computed, one per file, timeframe and period
+    uint64_t chunks;
+    uint32_t failedJobs;
+    double setupMs;
+    double computeMs; // Inside the library, the pushes only
+    double prepareMs; // Resampling
+    double inputWaitMs; // Computation waiting on the readers
+    double outputWaitMs; // Computation waiting on the writer
+    uint32_t storagePrecision;
+} BatchTotals;
+
+// Computes the SMA of a whole series chunk by chunk on the stream, starting a new series first.
+static bool PushSeries(ComputeStream* stream, const Candlestick* candles, size_t count, uint32_t chunkCandles, Indicator* indicators,
+                       float* values, BatchTotals* totals)
+{
+    ResetComputeStream(stream);
+    for (size_t offset = 0; offset < count; offset += chunkCandles)
+    {
+        size_t length = count - offset < chunkCandles ? count - offset : chunkCandles;
+        ComputeStats stats = {0};
+        double start = ComputeTimestampMs();
+        int status = PushComputeStream(stream, candles + offset, length, indicators, &stats);
+        totals->computeMs += ComputeTimestampMs() - start;
+        ++totals->chunks;
+        if (status != 0)
+            return false;
+        totals->storagePrecision = stats.storagePrecision;
+        for (size_t x = 0; x < length; ++x)
+            values[offset + x] = indicators[x].sma;
+    }
+    return true;
+}
+
+// Computes every timeframe and period of a file and queues its outputs.
+static void ComputeFile(Pipeline* pipeline, ComputeStream** streams, const BatchInput* input, Indicator* indicators, BatchTotals* totals)
+{
+    const BatchConfig* config = pipeline->config;
+    for (uint32_t t = 0; t < config->timeframeCount; ++t)
+    {
+        uint32_t timeframe = config->timeframes[t];
+        size_t count = GetResampledCount(input->count, timeframe);
+        Candlestick* resampled = NULL;
+        if (timeframe != 1)
+        {
+            double prepareStart = ComputeTimestampMs();
+            resampled = (Candlestick*)malloc(count * sizeof(Candlestick));
+            if (resampled == NULL)
+            {
+                fprintf(stderr, "skipping timeframe %u of %s: out of memory\n", timeframe, input->path);
+                totals->failedJobs += config->periodCount;
+                continue;
+            }
+            ResampleCandles(input->candles, input->count, timeframe, resampled);
+            totals->prepareMs += ComputeTimestampMs() - prepareStart;
+        }
+        const Candlestick* candles = resampled != NULL ? resampled : input->candles;
+
+        for (uint32_t p = 0; p < config->periodCount; ++p)
+        {
+            ++totals->jobs;
+            BatchOutput* output = (BatchOutput*)malloc(sizeof(BatchOutput));
+            float* values = output != NULL ? (float*)malloc(count * sizeof(float)) : NULL;
+            if (values == NULL || !PushSeries(streams[p], candles, count, config->chunkCandles, indicators, values, totals))
+            {
+                fprintf(stderr, "could not compute period %u, timeframe %u of %s\n", config->periods[p], timeframe, input->path);
+                ++totals->failedJobs;
+                free(values);
+                free(output);
+                continue;
+            }
+            *output = (BatchOutput){ .values = values, .count = count };
+            OutputPath(config, input->path, config->periods[p], timeframe, output->path, sizeof(output->path));
+            double waitStart = ComputeTimestampMs();
+            QueuePush(&pipeline->written, output);
+            totals->outputWaitMs += ComputeTimestampMs() - waitStart;
+        }
+        free(resampled);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BatchConfig config;
+    int firstPath = ParseArguments(argc, argv, &config);
+    if (firstPath == 0)
+    {
+        fprintf(stderr, "usage: %s --output-dir dir [--periods list] [--timeframes list] [--format binary|csv] [--backend vulkan|scalar|simd|threaded] [--device n] [--precision fp32|fp16] [--io-threads n] [--prefetch n] [--chunk-candles n] path...\n", argv[0]);
+        return 2;
+    }
+    if (mkdir(config.outputDirectory, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "could not create %s: %s\n", config.outputDirectory, strerror(errno));
+        return 1;
+    }
+
+    Pipeline pipeline = { .config = &config, .activeReaders = config.ioThreads };
+    pipeline.paths = CollectPaths(argv + firstPath, argc - firstPath, &pipeline.pathCount);
+    // Enough room in the output queue for the outputs of a few files, so the writer rarely holds the computation up.
+    pthread_t* readers = (pthread_t*)malloc(config.ioThreads * sizeof(pthread_t));
+    if (pipeline.paths == NULL || readers == NULL || !QueueInitialize(&pipeline.ready, config.prefetch) ||
+        !QueueInitialize(&pipeline.written, (size_t)config.prefetch * config.periodCount * config.timeframeCount))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (HasDuplicateFileNames(pipeline.paths, pipeline.pathCount))
+        return 1;
+    pthread_mutex_init(&pipeline.lock, NULL);
+
+    double start = ComputeTimestampMs();
+    pthread_t writer;
+    uint32_t readerCount = 0;
+    for (; readerCount < config.ioThreads; ++readerCount)
+    {
+        if (pthread_create(&readers[readerCount], NULL, ReaderMain, &pipeline) != 0)
+            break;
+    }
+    if (readerCount == 0 || pthread_create(&writer, NULL, WriterMain, &pipeline) != 0)
+    {
+        fprintf(stderr, "could not start the I/O threads\n");
+        return 1;
+    }
+    // Readers that did not start are not waited for.
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.activeReaders -= config.ioThreads - readerCount;
+    pthread_mutex_unlock(&pipeline.lock);
+
+    // The readers start prefetching while the streams are set up.
+    BatchTotals totals = {0};
+    ComputeStream* streams[MAX_LIST_ENTRIES];
+    Indicator* indicators = (Indicator*)malloc((size_t)config.chunkCandles * sizeof(Indicator));
+    for (uint32_t p = 0; p < config.periodCount; ++p)
+    {
+        ComputeOptions options = config.options;
+        options.period = config.periods[p];
+        ComputeStats stats = {0};
+        if (indicators == NULL || OpenComputeStream(config.chunkCandles, &options, &streams[p], &stats) != 0)
+        {
+            fprintf(stderr, "could not open a %s stream for period %u\n", BackendNames[config.options.backend], options.period);
+            return 1;
+        }
+        totals.setupMs += stats.setupMs;
+    }
+
+    for (;;)
+    {
+        double waitStart = ComputeTimestampMs();
+        BatchInput* input = (BatchInput*)QueuePop(&pipeline.ready, true);
+        totals.inputWaitMs += ComputeTimestampMs() - waitStart;
+        if (input == NULL)
+            break;
+        ComputeFile(&pipeline, streams, input, indicators, &totals);
+        totals.files++;
+        totals.candles += input->count;
+        free(input->candles);
+        free(input);
+    }
+    double computed = ComputeTimestampMs();
+    for (uint32_t r = 0; r < readerCount; ++r)
+        pthread_join(readers[r], NULL);
+    free(readers);
+    QueueClose(&pipeline.written);
+    pthread_join(writer, NULL);
+    double wallMs = ComputeTimestampMs() - start;
+
+    // The report is JSON like the benchmark's, so nightly runs can be compared.
+    printf("{\n  \"driver\": \"computesample-batch\",\n  \"backend\": \"%s\", \"precision\": \"%s\", \"format\": \"%s\",\n",
+           BackendNames[config.options.backend], PrecisionNames[totals.storagePrecision], config.format == OUTPUT_CSV ? "csv" : "binary");
+    printf("  \"files\": %llu, \"failedFiles\": %u, \"candles\": %llu, \"jobs\": %llu, \"chunks\": %llu, \"failedJobs\": %u, \"failedOutputs\": %u,\n",
+           (unsigned long long)totals.files, pipeline.failedFiles, (unsigned long long)totals.candles, (unsigned long long)totals.jobs,
+           (unsigned long long)totals.chunks, totals.failedJobs, pipeline.failedOutputs);
+    printf("  \"bytesRead\": %llu, \"bytesWritten\": %llu,\n", (unsigned long long)pipeline.bytesRead, (unsigned long long)pipeline.bytesWritten);
+    printf("  \"wallMs\": %.3f, \"candlesPerSecond\": %.1f, \"readMBPerSecond\": %.2f,\n",
+           wallMs, wallMs > 0 ? totals.candles / (wallMs / 1000.0) : 0, wallMs > 0 ? pipeline.bytesRead / (wallMs / 1000.0) / 1e6 : 0);
+    printf("  \"computeMs\": %.3f, \"setupMs\": %.3f, \"prepareMs\": %.3f, \"inputWaitMs\": %.3f, \"outputWaitMs\": %.3f, \"drainMs\": %.3f,\n",
+           totals.computeMs, totals.setupMs, totals.prepareMs, totals.inputWaitMs, totals.outputWaitMs, ComputeTimestampMs() - computed);
+    printf("  \"ioThreads\": %u, \"readMs\": %.3f, \"writeMs\": %.3f\n}\n", readerCount, pipeline.readMs, pipeline.writeMs);
+
+    for (uint32_t p = 0; p < config.periodCount; ++p)
+        CloseComputeStream(streams[p]);
+    free(indicators);
+    for (size_t p = 0; p < pipeline.pathCount; ++p)
+        free(pipeline.paths[p]);
+    free(pipeline.paths);
+    QueueDestroy(&pipeline.ready);
+    QueueDestroy(&pipeline.written);
+    pthread_mutex_destroy(&pipeline.lock);
+    return pipeline.failedFiles > 0 || pipeline.failedOutputs > 0 || totals.failedJobs > 0 ? 1 : 0;
+}
@@ -0,0 +1,726 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "computesample.h"
+
+// Throughput benchmark for every compute backend, run through `meson test --benchmark`.
+// Results are written as a single JSON document so runs can be diffed between releases.
+//
+// Usage: computesample-benchmark [--sizes 1000,10000] [--periods 14] [--batches 1,16]
+//                                [--backends vulkan,scalar,simd,threaded] [--precisions fp32,fp16]
+//                                [--kernels auto,naive,shared,subgroup] [--timeframes 5,15,60]
+//                                [--layout series|matrix] [--repeat 3] [--max-size N] [--output results.json]
+//        computesample-benchmark --verify [--periods 14,50] [--output results.json]
+//
+// With --timeframes every job resamples its series into those timeframes first and
+// candles/s counts the source candles. With --layout matrix the series of a batch
+// shape are computed as one cross-sectional job, percentiles included, instead of
+// one job per series.
+//
+// --verify times nothing: it checks every Vulkan device, precision and kernel
+// variant against the scalar backend on small series, through plain, resampled,
+// cross-sectional and streamed jobs and the rolling correlation, and exits with 1
+// when any result is off by more than the tolerance of its storage precision.
+// `meson test` runs it, a machine without a Vulkan device skips it.
+
+#define MAX_LIST_ENTRIES 16
+
+typedef struct BenchmarkConfig
+{
+    uint64_t sizes[MAX_LIST_ENTRIES];
+    uint32_t sizeCount;
+    uint64_t periods[MAX_LIST_ENTRIES];
+    uint32_t periodCount;
+    uint64_t batches[MAX_LIST_ENTRIES];
+    uint32_t batchCount;
+    bool backends[COMPUTE_BACKEND_CPU_THREADED + 1];
+    bool precisions[COMPUTE_PRECISION_FP16 + 1];
+    bool kernels[COMPUTE_KERNEL_SUBGROUP + 1];
+    uint32_t timeframes[COMPUTE_MAX_TIMEFRAMES];
+    uint32_t timeframeCount;
+    bool matrix;
+    bool verify;
+    uint32_t repeat;
+    uint64_t maxSize;
+    const char* outputPath;
+} BenchmarkConfig;
+
+typedef struct BenchmarkTarget
+{
+    ComputeOptions options;
+    const char* backendName;
+    char deviceName[256];
+} BenchmarkTarget;
+
+static const char* BackendNames[] = { "vulkan", "scalar", "simd", "threaded" };
+static const char* PrecisionNames[] = { "fp32", "fp16" };
+static const char* KernelNames[] = { "auto", "naive", "shared", "subgroup" };
+
+static uint32_t ParseList(const char* text, uint64_t* values)
+{
+    uint32_t count = 0;
+    while (*text != '\0' && count < MAX_LIST_ENTRIES)
+    {
+        char* end = NULL;
+        double value = strtod(text, &end); // strtod so that 1e8 is accepted
+        if (end == text)
+            break;
+        values[count++] = (uint64_t)value;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkConfig* config)
+{
+    *config = (BenchmarkConfig){
+        .sizes = { 1000, 10000, 100000, 1000000, 10000000, 100000000 },
+        .sizeCount = 6,
+        .periods = { SMA_DEFAULT_PERIOD, 50 },
+        .periodCount = 2,
+        .batches = { 1, 16 },
+        .batchCount = 2,
+        .backends = { true, true, true, true },
+        .precisions = { true, true },
+        .kernels = { [COMPUTE_KERNEL_AUTO] = true },
+        .repeat = 3,
+        .maxSize = UINT64_MAX,
+        .outputPath = NULL
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verify") == 0)
+        {
+            config->verify = true;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return false;
+        if (strcmp(argv[i], "--sizes") == 0)
+            config->sizeCount = ParseList(value, config->sizes);
+        else if (strcmp(argv[i], "--periods") == 0)
+            config->periodCount = ParseList(value, config->periods);
+        else if (strcmp(argv[i], "--batches") == 0)
+            config->batchCount = ParseList(value, config->batches);
+        else if (strcmp(argv[i], "--repeat") == 0)
+            config->repeat = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--max-size") == 0)
+            config->maxSize = (uint64_t)strtod(value, NULL);
+        else if (strcmp(argv[i], "--output") == 0)
+            config->outputPath = value;
+        else if (strcmp(argv[i], "--timeframes") == 0)
+        {
+            uint64_t timeframes[MAX_LIST_ENTRIES];
+            uint32_t count = ParseList(value, timeframes);
+            config->timeframeCount = 0;
+            for (uint32_t t = 0; t < count && config->timeframeCount < COMPUTE_MAX_TIMEFRAMES; ++t)
+            {
+                if (timeframes[t] > 0)
+                    config->timeframes[config->timeframeCount++] = (uint32_t)timeframes[t];
+            }
+        }
+        else if (strcmp(argv[i], "--layout") == 0)
+            config->matrix = strcmp(value, "matrix") == 0;
+        else if (strcmp(argv[i], "--precisions") == 0)
+        {
+            for (int p = 0; p <= COMPUTE_PRECISION_FP16; ++p)
+                config->precisions[p] = strstr(value, PrecisionNames[p]) != NULL;
+        }
+        else if (strcmp(argv[i], "--kernels") == 0)
+        {
+            for (int k = 0; k <= COMPUTE_KERNEL_SUBGROUP; ++k)
+                config->kernels[k] = strstr(value, KernelNames[k]) != NULL;
+        }
+        else if (strcmp(argv[i], "--backends") == 0)
+        {
+            memset(config->backends, 0, sizeof(config->backends));
+            for (int b = 0; b <= COMPUTE_BACKEND_CPU_THREADED; ++b)
+                config->backends[b] = strstr(value, BackendNames[b]) != NULL;
+        }
+        else
+            return false;
+        ++i;
+    }
+    if (config->repeat == 0)
+        config->repeat = 1;
+    // Cross-sectional jobs do not resample.
+    return !(config->matrix && config->timeframeCount > 0);
+}
+
+// Geometric random walk with xorshift noise, deterministic for a given seed.
+static void GenerateCandles(Candlestick* candles, size_t count, uint64_t seed)
+{
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    float price = 100.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        float noise = (float)((double)(state >> 11) / (double)(1ull << 53)) - 0.5f;
+        float open = price;
+        float close = open * (1.0f + noise * 0.01f);
+        float spread = fabsf(noise) * 0.005f * open;
+        candles[i] = (Candlestick){
+            .open = open,
+            .high = fmaxf(open, close) + spread,
+            .low = fminf(open, close) - spread,
+            .close = close
+        };
+        price = close;
+    }
+}
+
+// Number of indicators computed for one series, less than its length once resampled.
+static size_t OutputLength(const BenchmarkConfig* config, size_t seriesLength)
+{
+    if (config->timeframeCount == 0)
+        return seriesLength;
+    size_t length = 0;
+    for (uint32_t t = 0; t < config->timeframeCount; ++t)
+        length += GetResampledCount(seriesLength, config->timeframes[t]);
+    return length;
+}
+
+// Computes seriesCount consecutive series, seriesCount is only above 1 for the matrix layout.
+static int RunJob(const BenchmarkConfig* config, const Candlestick* kline, size_t seriesCount, size_t seriesLength, Indicator* output,
+                  float* percentile, const ComputeOptions* options, ComputeStats* stats)
+{
+    if (config->matrix)
+        return ComputeCrossSectionalResult(kline, (uint32_t)seriesCount, seriesLength, output, percentile, options, stats);
+    if (config->timeframeCount == 0)
+        return ComputeResultEx(kline, seriesLength, output, options, stats);
+    return ComputeResampledResult(kline, seriesLength, config->timeframes, config->timeframeCount, NULL, output, options, stats);
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+static double Median(double* values, uint32_t count)
+{
+    qsort(values, count, sizeof(double), CompareDoubles);
+    return (count % 2) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static float MaxAbsoluteError(const Indicator* a, const Indicator* b, size_t count)
+{
+    float error = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float difference = fabsf(a[i].sma - b[i].sma);
+        if (difference > error || isnan(difference))
+            error = difference;
+    }
+    return error;
+}
+
+static float MaxFloatError(const float* a, const float* b, size_t count)
+{
+    float error = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float difference = fabsf(a[i] - b[i]);
+        if (difference > error || isnan(difference))
+            error = difference;
+    }
+    return error;
+}
+
+static void PrintJsonString(FILE* out, const char* text)
+{
+    fputc('"', out);
+    for (; *text != '\0'; ++text)
+    {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*text >= 0x20)
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+static uint32_t CollectTargets(const BenchmarkConfig* config, BenchmarkTarget* targets, uint32_t capacity)
+{
+    uint32_t count = 0;
+    if (config->backends[COMPUTE_BACKEND_VULKAN])
+    {
+        // Every physical device is benchmarked, which includes lavapipe when it is installed.
+        uint32_t deviceCount = GetComputeDeviceCount();
+        for (uint32_t d = 0; d < deviceCount; ++d)
+        {
+            for (int p = 0; p <= COMPUTE_PRECISION_FP16; ++p)
+            {
+                for (int k = 0; k <= COMPUTE_KERNEL_SUBGROUP && count < capacity; ++k)
+                {
+                    if (!config->precisions[p] || !config->kernels[k])
+                        continue;
+                    BenchmarkTarget* target = &targets[count++];
+                    *target = (BenchmarkTarget){
+                        .options = { .backend = COMPUTE_BACKEND_VULKAN, .deviceIndex = d, .storagePrecision = p, .kernelVariant = k },
+                        .backendName = BackendNames[COMPUTE_BACKEND_VULKAN]
+                    };
+                    if (GetComputeDeviceName(d, target->deviceName, sizeof(target->deviceName)) != 0)
+                        snprintf(target->deviceName, sizeof(target->deviceName), "device %u", d);
+                }
+            }
+        }
+    }
+    for (int b = COMPUTE_BACKEND_CPU_SCALAR; b <= COMPUTE_BACKEND_CPU_THREADED && count < capacity; ++b)
+    {
+        if (!config->backends[b])
+            continue;
+        BenchmarkTarget* target = &targets[count++];
+        *target = (BenchmarkTarget){
+            .options = { .backend = b },
+            .backendName = BackendNames[b]
+        };
+        snprintf(target->deviceName, sizeof(target->deviceName), "host");
+    }
+    return count;
+}
+
+// Verification shapes: none of them is a multiple of a workgroup or of the matrix
+// padding, and the series spans enough workgroups for the scan kernels to carry
+// their partial sums from one to the next.
+#define VERIFY_SERIES_LENGTH 65537
+#define VERIFY_SYMBOLS 13
+#define VERIFY_TIME 4099
+#define VERIFY_STREAM_CHUNK 4096
+#define VERIFY_CORRELATION_WINDOW 60
+#define VERIFY_CORRELATION_STEP 7
+// SMA and candle errors are relative to max(1, |reference|), half floats keep 11
+// significant bits. Correlations lie in [-1, 1] and their error is absolute.
+#define VERIFY_TOLERANCE_FP32 1e-4
+#define VERIFY_TOLERANCE_FP16 4e-3
+#define VERIFY_TOLERANCE_PERCENTILE 1e-6
+#define VERIFY_TOLERANCE_CORRELATION 1e-3
+
+static const uint32_t VerifyTimeframes[] = { 1, 5, 60 };
+// Pushed in turn, from a single candle to a full chunk, shorter and longer than the halo.
+static const size_t VerifyStreamChunks[] = { VERIFY_STREAM_CHUNK, 1, 15, 2048, VERIFY_STREAM_CHUNK - 1, 51, 333 };
+
+typedef struct VerifyReport
+{
+    FILE* out;
+    bool first;
+    uint32_t failures;
+} VerifyReport;
+
+static double RelativeError(float reference, float value)
+{
+    return fabs((double)value - reference) / fmax(1.0, fabs((double)reference));
+}
+
+static double MaxRelativeError(const Indicator* reference, const Indicator* output, size_t count)
+{
+    double error = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double difference = RelativeError(reference[i].sma, output[i].sma);
+        if (difference > error || isnan(difference))
+            error = difference;
+    }
+    return error;
+}
+
+static double MaxCandleError(const Candlestick* reference, const Candlestick* candles, size_t count)
+{
+    double error = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double differences[] = {
+            RelativeError(reference[i].open, candles[i].open), RelativeError(reference[i].high, candles[i].high),
+            RelativeError(reference[i].low, candles[i].low), RelativeError(reference[i].close, candles[i].close)
+        };
+        for (size_t d = 0; d < sizeof(differences) / sizeof(differences[0]); ++d)
+        {
+            if (differences[d] > error || isnan(differences[d]))
+                error = differences[d];
+        }
+    }
+    return error;
+}
+
+static double SmaTolerance(const ComputeStats* stats)
+{
+    return stats->storagePrecision == COMPUTE_PRECISION_FP16 ? VERIFY_TOLERANCE_FP16 : VERIFY_TOLERANCE_FP32;
+}
+
+// Percentile of every SMA among the symbols at its time, as ComputeCrossSectionalResult defines it.
+static void RankPercentiles(const Indicator* sma, uint32_t symbolCount, size_t timeCount, float* percentile)
+{
+    for (size_t t = 0; t < timeCount; ++t)
+    {
+        for (uint32_t s = 0; s < symbolCount; ++s)
+        {
+            float value = sma[s * timeCount + t].sma;
+            uint32_t below = 0;
+            uint32_t equal = 0;
+            for (uint32_t o = 0; o < symbolCount; ++o)
+            {
+                below += sma[o * timeCount + t].sma < value;
+                equal += sma[o * timeCount + t].sma == value;
+            }
+            percentile[s * timeCount + t] = (float)((below + 0.5 * equal) / symbolCount);
+        }
+    }
+}
+
+// Prints one check and counts it as failed when its jobs failed or its error is above
+// tolerance. stats is NULL for the checks that do not depend on the precision and kernel.
+static void ReportCheck(VerifyReport* report, const char* check, const BenchmarkTarget* target, const ComputeStats* stats,
+                        uint32_t period, int status, double error, double tolerance)
+{
+    bool passed = status == 0 && error <= tolerance;
+    fprintf(report->out, "%s\n    {\"check\": \"%s\", \"device\": ", report->first ? "" : ",", check);
+    PrintJsonString(report->out, target->deviceName);
+    report->first = false;
+    if (stats != NULL)
+    {
+        fprintf(report->out, ", \"requestedPrecision\": \"%s\", \"requestedKernel\": \"%s\"",
+            PrecisionNames[target->options.storagePrecision], KernelNames[target->options.kernelVariant]);
+        if (status == 0)
+            fprintf(report->out, ", \"precision\": \"%s\", \"kernel\": \"%s\"", PrecisionNames[stats->storagePrecision], KernelNames[stats->kernelVariant]);
+    }
+    if (period != 0)
+        fprintf(report->out, ", \"period\": %u", period);
+    fprintf(report->out, ", \"status\": \"%s\"", status != 0 ? "failed" : (passed ? "ok" : "mismatch"));
+    if (status == 0 && isfinite(error))
+        fprintf(report->out, ", \"maxError\": %g, \"tolerance\": %g", error, tolerance);
+    fprintf(report->out, "}");
+    if (!passed)
+        ++report->failures;
+}
+
+// Plain, streamed and resampled jobs over one series.
+static void VerifySeries(VerifyReport* report, const BenchmarkTarget* target, const Candlestick* candles, uint32_t period)
+{
+    size_t length = VERIFY_SERIES_LENGTH;
+    uint32_t timeframeCount = sizeof(VerifyTimeframes) / sizeof(VerifyTimeframes[0]);
+    size_t resampledLength = 0; // At least length, the first timeframe is 1
+    for (uint32_t t = 0; t < timeframeCount; ++t)
+        resampledLength += GetResampledCount(length, VerifyTimeframes[t]);
+    Indicator* reference = (Indicator*)malloc(resampledLength * sizeof(Indicator));
+    Indicator* output = (Indicator*)malloc(resampledLength * sizeof(Indicator));
+    Candlestick* referenceCandles = (Candlestick*)malloc(resampledLength * sizeof(Candlestick));
+    Candlestick* resampled = (Candlestick*)malloc(resampledLength * sizeof(Candlestick));
+    if (reference == NULL || output == NULL || referenceCandles == NULL || resampled == NULL)
+    {
+        ReportCheck(report, "sma", target, NULL, period, 1, 0, 0);
+        free(reference);
+        free(output);
+        free(referenceCandles);
+        free(resampled);
+        return;
+    }
+    ComputeOptions referenceOptions = { .backend = COMPUTE_BACKEND_CPU_SCALAR, .period = period };
+    ComputeOptions options = target->options;
+    options.period = period;
+
+    ComputeStats stats = {0};
+    int status = ComputeResultEx(candles, length, reference, &referenceOptions, NULL) | ComputeResultEx(candles, length, output, &options, &stats);
+    ReportCheck(report, "sma", target, &stats, period, status, MaxRelativeError(reference, output, length), SmaTolerance(&stats));
+
+    // Twice through the same stream, cut differently each time, which also covers
+    // ResetComputeStream. Each output has to match the plain job still in reference.
+    ComputeStream* stream = NULL;
+    stats = (ComputeStats){0};
+    status = OpenComputeStream(VERIFY_STREAM_CHUNK, &options, &stream, &stats);
+    double error = 0;
+    for (size_t pass = 0; pass < 2 && status == 0; ++pass)
+    {
+        ResetComputeStream(stream);
+        memset(output, 0, length * sizeof(Indicator));
+        size_t chunk = pass;
+        for (size_t offset = 0; offset < length && status == 0; )
+        {
+            size_t size = VerifyStreamChunks[chunk++ % (sizeof(VerifyStreamChunks) / sizeof(VerifyStreamChunks[0]))];
+            size = size < length - offset ? size : length - offset;
+            status = PushComputeStream(stream, candles + offset, size, output + offset, &stats);
+            offset += size;
+        }
+        error = fmax(error, MaxRelativeError(reference, output, length));
+    }
+    CloseComputeStream(stream);
+    ReportCheck(report, "stream", target, &stats, period, status, error, SmaTolerance(&stats));
+
+    stats = (ComputeStats){0};
+    status = ComputeResampledResult(candles, length, VerifyTimeframes, timeframeCount, referenceCandles, reference, &referenceOptions, NULL) |
+             ComputeResampledResult(candles, length, VerifyTimeframes, timeframeCount, resampled, output, &options, &stats);
+    error = fmax(MaxRelativeError(reference, output, resampledLength), MaxCandleError(referenceCandles, resampled, resampledLength));
+    ReportCheck(report, "resample", target, &stats, period, status, error, SmaTolerance(&stats));
+
+    free(reference);
+    free(output);
+    free(referenceCandles);
+    free(resampled);
+}
+
+// Cross-sectional SMA and percentiles over VERIFY_SYMBOLS series of VERIFY_TIME candles.
+static void VerifyCrossSectional(VerifyReport* report, const BenchmarkTarget* target, const Candlestick* candles, uint32_t period)
+{
+    size_t count = (size_t)VERIFY_SYMBOLS * VERIFY_TIME;
+    Indicator* reference = (Indicator*)malloc(count * sizeof(Indicator));
+    Indicator* output = (Indicator*)malloc(count * sizeof(Indicator));
+    float* percentile = (float*)malloc(count * sizeof(float));
+    float* expected = (float*)malloc(count * sizeof(float));
+    ComputeOptions referenceOptions = { .backend = COMPUTE_BACKEND_CPU_SCALAR, .period = period };
+    ComputeOptions options = target->options;
+    options.period = period;
+    ComputeStats stats = {0};
+    int status = reference == NULL || output == NULL || percentile == NULL || expected == NULL ||
+                 ComputeCrossSectionalResult(candles, VERIFY_SYMBOLS, VERIFY_TIME, reference, NULL, &referenceOptions, NULL) != 0 ||
+                 ComputeCrossSectionalResult(candles, VERIFY_SYMBOLS, VERIFY_TIME, output, percentile, &options, &stats) != 0;
+    ReportCheck(report, "cross-sectional", target, &stats, period, status, status == 0 ? MaxRelativeError(reference, output, count) : 0, SmaTolerance(&stats));
+
+    // Near ties can swap between backends, so the percentiles are checked against the
+    // ranks of the SMA the device computed rather than those of the scalar one.
+    double error = 0;
+    if (status == 0)
+    {
+        RankPercentiles(output, VERIFY_SYMBOLS, VERIFY_TIME, expected);
+        error = MaxFloatError(expected, percentile, count);
+    }
+    ReportCheck(report, "rank", target, &stats, period, status, error, VERIFY_TOLERANCE_PERCENTILE);
+    free(reference);
+    free(output);
+    free(percentile);
+    free(expected);
+}
+
+// The correlation matrices of the cross-sectional series, the device always computes them in 32 bits.
+static void VerifyCorrelation(VerifyReport* report, const BenchmarkTarget* target, const Candlestick* candles)
+{
+    CorrelationOptions correlation = { .window = VERIFY_CORRELATION_WINDOW, .step = VERIFY_CORRELATION_STEP };
+    size_t count = GetCorrelationMatrixCount(VERIFY_TIME, correlation.window, correlation.step) * VERIFY_SYMBOLS * VERIFY_SYMBOLS;
+    float* reference = (float*)malloc(count * sizeof(float));
+    float* matrices = (float*)malloc(count * sizeof(float));
+    ComputeOptions referenceOptions = { .backend = COMPUTE_BACKEND_CPU_SCALAR };
+    int status = reference == NULL || matrices == NULL ||
+                 ComputeRollingCorrelation(candles, VERIFY_SYMBOLS, VERIFY_TIME, &correlation, reference, NULL, NULL, &referenceOptions, NULL) != 0 ||
+                 ComputeRollingCorrelation(candles, VERIFY_SYMBOLS, VERIFY_TIME, &correlation, matrices, NULL, NULL, &target->options, NULL) != 0;
+    ReportCheck(report, "correlation", target, NULL, 0, status, status == 0 ? MaxFloatError(reference, matrices, count) : 0, VERIFY_TOLERANCE_CORRELATION);
+    free(reference);
+    free(matrices);
+}
+
+// Returns 1 when a check failed and 77, which meson reports as skipped, without a Vulkan device.
+static int Verify(const BenchmarkConfig* config, FILE* out)
+{
+    BenchmarkConfig vulkan = {
+        .backends = { [COMPUTE_BACKEND_VULKAN] = true },
+        .precisions = { true, true },
+        .kernels = { true, true, true, true }
+    };
+    BenchmarkTarget targets[64];
+    uint32_t targetCount = CollectTargets(&vulkan, targets, 64);
+    if (targetCount == 0)
+    {
+        fprintf(stderr, "no Vulkan device to verify\n");
+        return 77;
+    }
+    Candlestick* series = (Candlestick*)malloc(VERIFY_SERIES_LENGTH * sizeof(Candlestick));
+    Candlestick* symbols = (Candlestick*)malloc((size_t)VERIFY_SYMBOLS * VERIFY_TIME * sizeof(Candlestick));
+    if (series == NULL || symbols == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        free(series);
+        free(symbols);
+        return 1;
+    }
+    GenerateCandles(series, VERIFY_SERIES_LENGTH, VERIFY_SERIES_LENGTH);
+    // A seed per symbol, identical walks would only rank ties.
+    for (uint32_t s = 0; s < VERIFY_SYMBOLS; ++s)
+        GenerateCandles(symbols + (size_t)s * VERIFY_TIME, VERIFY_TIME, s + 1);
+
+    VerifyReport report = { .out = out, .first = true };
+    fprintf(out, "{\n  \"verify\": \"computesample-sma\",\n  \"checks\": [");
+    for (uint32_t t = 0; t < targetCount; ++t)
+    {
+        for (uint32_t p = 0; p < config->periodCount; ++p)
+        {
+            VerifySeries(&report, &targets[t], series, (uint32_t)config->periods[p]);
+            VerifyCrossSectional(&report, &targets[t], symbols, (uint32_t)config->periods[p]);
+        }
+        // Once per device, on its first target.
+        if (t == 0 || targets[t].options.deviceIndex != targets[t - 1].options.deviceIndex)
+            VerifyCorrelation(&report, &targets[t], symbols);
+    }
+    fprintf(out, "\n  ],\n  \"failures\": %u\n}\n", report.failures);
+    free(series);
+    free(symbols);
+    return report.failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkConfig config;
+    if (!ParseArguments(argc, argv, &config))
+    {
+        fprintf(stderr, "usage: %s [--sizes list] [--periods list] [--batches list] [--backends list] [--precisions list] [--kernels list] [--timeframes list] [--layout series|matrix] [--repeat n] [--max-size n] [--output file]\n"
+                        "       %s --verify [--periods list] [--output file]\n", argv[0], argv[0]);
+        return 2;
+    }
+    FILE* out = stdout;
+    if (config.outputPath != NULL && (out = fopen(config.outputPath, "w")) == NULL)
+    {
+        fprintf(stderr, "could not open %s for writing\n", config.outputPath);
+        return 1;
+    }
+    if (config.verify)
+    {
+        int result = Verify(&config, out);
+        if (out != stdout)
+            fclose(out);
+        return result;
+    }
+
+    BenchmarkTarget targets[64];
+    uint32_t targetCount = CollectTargets(&config, targets, 64);
+
+    fprintf(out, "{\n  \"benchmark\": \"computesample-sma\",\n  \"repeat\": %u,\n  \"results\": [", config.repeat);
+    bool firstResult = true;
+
+    for (uint32_t s = 0; s < config.sizeCount; ++s)
+    {
+        size_t size = (size_t)config.sizes[s];
+        if (size == 0 || size > config.maxSize)
+            continue;
+        // Resampling can need more indicators than candles, e.g. timeframes 1 and 2.
+        size_t outputCapacity = size;
+        for (uint32_t b = 0; b < config.batchCount; ++b)
+        {
+            size_t batch = config.batches[b] == 0 ? 1 : (size_t)config.batches[b];
+            size_t required = batch * OutputLength(&config, size / batch);
+            outputCapacity = required > outputCapacity ? required : outputCapacity;
+        }
+        Candlestick* candles = (Candlestick*)malloc(size * sizeof(Candlestick));
+        Indicator* reference = (Indicator*)malloc(outputCapacity * sizeof(Indicator));
+        Indicator* output = (Indicator*)malloc(outputCapacity * sizeof(Indicator));
+        // Matrix jobs never resample, so their percentiles fit in size.
+        float* referencePercentile = config.matrix ? (float*)malloc(size * sizeof(float)) : NULL;
+        float* percentile = config.matrix ? (float*)malloc(size * sizeof(float)) : NULL;
+        if (candles == NULL || reference == NULL || output == NULL || (config.matrix && (referencePercentile == NULL || percentile == NULL)))
+        {
+            fprintf(stderr, "skipping size %zu: out of memory\n", size);
+            free(candles);
+            free(reference);
+            free(output);
+            free(referencePercentile);
+            free(percentile);
+            continue;
+        }
+        GenerateCandles(candles, size, size);
+
+        for (uint32_t p = 0; p < config.periodCount; ++p)
+        {
+            for (uint32_t b = 0; b < config.batchCount; ++b)
+            {
+                // A batch shape splits the series into equally sized independent jobs.
+                size_t batch = config.batches[b] == 0 ? 1 : (size_t)config.batches[b];
+                size_t seriesLength = size / batch;
+                size_t outputLength = OutputLength(&config, seriesLength);
+                if (seriesLength <= config.periods[p])
+                    continue;
+                // A job covers every series with the matrix layout, a single one otherwise.
+                size_t seriesPerJob = config.matrix ? batch : 1;
+                size_t jobCount = batch / seriesPerJob;
+
+                ComputeOptions referenceOptions = { .backend = COMPUTE_BACKEND_CPU_SCALAR, .period = (uint32_t)config.periods[p] };
+                for (size_t j = 0; j < jobCount; ++j)
+                    RunJob(&config, candles + j * seriesPerJob * seriesLength, seriesPerJob, seriesLength, reference + j * seriesPerJob * outputLength,
+                           referencePercentile, &referenceOptions, NULL);
+
+                for (uint32_t t = 0; t < targetCount; ++t)
+                {
+                    ComputeOptions options = targets[t].options;
+                    options.period = (uint32_t)config.periods[p];
+                    double total[config.repeat], setup[config.repeat], upload[config.repeat], compute[config.repeat], readback[config.repeat];
+                    double gpuUpload[config.repeat], gpuCompute[config.repeat], gpuReadback[config.repeat];
+                    bool gpuTimestamps = true;
+                    uint32_t precision = COMPUTE_PRECISION_FP32;
+                    uint32_t kernel = COMPUTE_KERNEL_AUTO;
+                    uint32_t workgroupSize = 0;
+                    int status = 0;
+                    for (uint32_t r = 0; r < config.repeat && status == 0; ++r)
+                    {
+                        total[r] = setup[r] = upload[r] = compute[r] = readback[r] = 0;
+                        gpuUpload[r] = gpuCompute[r] = gpuReadback[r] = 0;
+                        double start = ComputeTimestampMs();
+                        for (size_t j = 0; j < jobCount && status == 0; ++j)
+                        {
+                            ComputeStats stats = {0};
+                            status = RunJob(&config, candles + j * seriesPerJob * seriesLength, seriesPerJob, seriesLength, output + j * seriesPerJob * outputLength,
+                                            percentile, &options, &stats);
+                            setup[r] += stats.setupMs;
+                            upload[r] += stats.uploadMs;
+                            compute[r] += stats.computeMs;
+                            readback[r] += stats.readbackMs;
+                            gpuUpload[r] += stats.gpuUploadMs;
+                            gpuCompute[r] += stats.gpuResampleMs + stats.gpuSmaPass1Ms + stats.gpuSmaPass2Ms + stats.gpuRankMs;
+                            gpuReadback[r] += stats.gpuReadbackMs;
+                            gpuTimestamps = gpuTimestamps && stats.gpuTimestampsValid;
+                            precision = stats.storagePrecision;
+                            kernel = stats.kernelVariant;
+                            workgroupSize = stats.workgroupSize;
+                        }
+                        total[r] = ComputeTimestampMs() - start;
+                    }
+
+                    fprintf(out, "%s\n    {\"backend\": \"%s\", \"device\": ", firstResult ? "" : ",", targets[t].backendName);
+                    PrintJsonString(out, targets[t].deviceName);
+                    fprintf(out, ", \"candles\": %zu, \"period\": %u, \"batch\": %zu, \"requestedPrecision\": \"%s\"",
+                        seriesLength * batch, options.period, batch, PrecisionNames[options.storagePrecision]);
+                    firstResult = false;
+                    for (uint32_t f = 0; f < config.timeframeCount; ++f)
+                        fprintf(out, "%s%u%s", f == 0 ? ", \"timeframes\": [" : ", ", config.timeframes[f], f + 1 == config.timeframeCount ? "]" : "");
+                    if (config.matrix)
+                        fprintf(out, ", \"layout\": \"matrix\"");
+                    if (status != 0)
+                    {
+                        fprintf(out, ", \"status\": \"unsupported\"}");
+                        continue;
+                    }
+                    double totalMs = Median(total, config.repeat);
+                    fprintf(out, ", \"precision\": \"%s\"", PrecisionNames[precision]);
+                    if (options.backend == COMPUTE_BACKEND_VULKAN)
+                        fprintf(out, ", \"kernel\": \"%s\", \"workgroupSize\": %u", KernelNames[kernel], workgroupSize);
+                    if (gpuTimestamps)
+                    {
+                        fprintf(out, ", \"gpuUploadMs\": %.4f, \"gpuComputeMs\": %.4f, \"gpuReadbackMs\": %.4f",
+                            Median(gpuUpload, config.repeat), Median(gpuCompute, config.repeat), Median(gpuReadback, config.repeat));
+                    }
+                    fprintf(out, ", \"status\": \"ok\", \"candlesPerSecond\": %.1f, \"totalMs\": %.4f, \"setupMs\": %.4f, \"uploadMs\": %.4f, \"computeMs\": %.4f, \"readbackMs\": %.4f, \"maxAbsError\": %g",
+                        (double)(seriesLength * batch) / (totalMs / 1000.0), totalMs,
+                        Median(setup, config.repeat), Median(upload, config.repeat),
+                        Median(compute, config.repeat), Median(readback, config.repeat),
+                        (double)MaxAbsoluteError(reference, output, outputLength * batch));
+                    // Near ties can swap between backends, which moves a percentile by 1 / batch.
+                    if (config.matrix)
+                        fprintf(out, ", \"maxPercentileError\": %g", (double)MaxFloatError(referencePercentile, percentile, seriesLength * batch));
+                    fprintf(out, "}");
+                }
+            }
+        }
+        free(candles);
+        free(reference);
+        free(output);
+        free(referencePercentile);
+        free(percentile);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
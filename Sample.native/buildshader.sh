@@ -1,4 +0,0 @@
-#!/bin/bash
-
-glslangValidator -V sma_shaderPass1.comp -o smaPass1.spv
-glslangValidator -V sma_shaderPass2.comp -o smaPass2.spv
\ No newline at end of file
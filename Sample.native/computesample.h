@@ -0,0 +1,264 @@
+#ifndef COMPUTESAMPLE_H
+#define COMPUTESAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SMA_DEFAULT_PERIOD 14
+#define COMPUTE_MAX_TIMEFRAMES 8
+
+typedef struct Candlestick
+{
+    float open;
+    float high;
+    float low;
+    float close;
+} Candlestick;
+
+typedef struct Indicator
+{
+    float sma;
+    float padding1; // Can be used for future Indicators inclusion like DI+/DI-/ADX and so forth
+    float padding2;
+    float padding3;
+} Indicator;
+
+typedef enum ComputeBackend
+{
+    COMPUTE_BACKEND_VULKAN = 0,
+    COMPUTE_BACKEND_CPU_SCALAR = 1,
+    COMPUTE_BACKEND_CPU_SIMD = 2,
+    COMPUTE_BACKEND_CPU_THREADED = 3
+} ComputeBackend;
+
+// Storage format of the candle and indicator buffers on the device. Arithmetic is
+// always done in 32 bit floats, COMPUTE_PRECISION_FP16 only narrows the memory
+// traffic and silently falls back to FP32 on devices without 16 bit storage.
+typedef enum ComputePrecision
+{
+    COMPUTE_PRECISION_FP32 = 0,
+    COMPUTE_PRECISION_FP16 = 1
+} ComputePrecision;
+
+// Implementation of the first SMA pass on the Vulkan backend. COMPUTE_KERNEL_AUTO
+// picks the subgroup scan when the device supports subgroup arithmetic in compute
+// shaders, the shared memory scan otherwise. A variant the device cannot run
+// falls back to the next one down.
+typedef enum ComputeKernelVariant
+{
+    COMPUTE_KERNEL_AUTO = 0,
+    COMPUTE_KERNEL_NAIVE = 1,
+    COMPUTE_KERNEL_SHARED = 2,
+    COMPUTE_KERNEL_SUBGROUP = 3
+} ComputeKernelVariant;
+
+// Options for ComputeResultEx, a zero initialized struct selects the defaults
+// (Vulkan on the first physical device, SMA_DEFAULT_PERIOD, one thread per core,
+// the autotuned workgroup size).
+typedef struct ComputeOptions
+{
+    int32_t backend;
+    uint32_t deviceIndex;
+    uint32_t period;
+    uint32_t threadCount;
+    uint32_t storagePrecision;
+    uint32_t kernelVariant;
+    uint32_t workgroupSize; // Forces a Vulkan workgroup size, 0 uses the autotuned one
+} ComputeOptions;
+
+// Timings in milliseconds for each stage of a single computation. The first
+// group is measured on the host, setupMs covering instance through pipeline
+// and uploadMs/readbackMs including their staging memcpy. The gpu fields come
+// from timestamp queries and are only set when gpuTimestampsValid is nonzero.
+typedef struct ComputeStats
+{
+    double setupMs;
+    double uploadMs;
+    double computeMs;
+    double readbackMs;
+
+    double instanceMs;
+    double deviceMs;
+    double allocationMs;
+    double pipelineMs;
+    double autotuneMs; // Workgroup size tuning, only on the first large job per device
+    double uploadCopyMs;
+    double readbackCopyMs;
+
+    double gpuUploadMs;
+    double gpuResampleMs; // Only set by ComputeResampledResult
+    double gpuSmaPass1Ms;
+    double gpuSmaPass2Ms;
+    double gpuRankMs; // Only set by ComputeCrossSectionalResult with percentiles
+    double gpuCorrelationMs; // Only set by ComputeRollingCorrelation
+    double gpuReadbackMs;
+    uint32_t gpuTimestampsValid;
+    uint32_t storagePrecision; // The ComputePrecision actually used
+    uint32_t kernelVariant; // The ComputeKernelVariant actually used
+    uint32_t workgroupSize;
+} ComputeStats;
+
+int ComputeResult(Candlestick* kline, size_t kline_elements_count, Indicator* output);
+int ComputeResultEx(const Candlestick* kline, size_t kline_elements_count, Indicator* output, const ComputeOptions* options, ComputeStats* stats);
+int ComputeResultCpu(const Candlestick* kline, size_t kline_elements_count, Indicator* output, const ComputeOptions* options, ComputeStats* stats);
+
+// Timeframe resampling. Every timeframes[t] consecutive candles, counted from the
+// first one, merge into one candle (first open, highest high, lowest low, last
+// close), so 1 minute candles with timeframes {5, 15, 60, 1440} give 5m, 15m, 1h
+// and 1d candles. The last candle of a timeframe may cover fewer candles.
+size_t GetResampledCount(size_t kline_elements_count, uint32_t timeframe);
+void ResampleCandles(const Candlestick* kline, size_t kline_elements_count, uint32_t timeframe, Candlestick* resampled);
+
+// Resamples kline into up to COMPUTE_MAX_TIMEFRAMES timeframes and computes the SMA
+// of each one. On Vulkan the resampled candles never leave the device and the whole
+// job is a single submission. The results of each timeframe follow those of the
+// previous one in output, and in resampled when it is not NULL, so both hold the
+// sum of GetResampledCount over the timeframes.
+int ComputeResampledResult(const Candlestick* kline, size_t kline_elements_count, const uint32_t* timeframes, uint32_t timeframe_count,
+                           Candlestick* resampled, Indicator* output, const ComputeOptions* options, ComputeStats* stats);
+int ComputeResampledResultCpu(const Candlestick* kline, size_t kline_elements_count, const uint32_t* timeframes, uint32_t timeframe_count,
+                              Candlestick* resampled, Indicator* output, const ComputeOptions* options, ComputeStats* stats);
+
+// Cross-sectional jobs. kline holds symbol_count series of time_count time aligned
+// candles laid out [symbol][time], and output receives their SMA in the same layout.
+// On Vulkan the series become the rows of a padded matrix that every pass covers
+// with a single 2D dispatch. When percentile is not NULL it also receives, per
+// [symbol][time], the rank of each SMA among all symbols at that time as a
+// percentile: (symbols below + half of those equal, itself included) / symbol_count.
+int ComputeCrossSectionalResult(const Candlestick* kline, uint32_t symbol_count, size_t time_count, Indicator* output, float* percentile,
+                                const ComputeOptions* options, ComputeStats* stats);
+int ComputeCrossSectionalResultCpu(const Candlestick* kline, uint32_t symbol_count, size_t time_count, Indicator* output, float* percentile,
+                                   const ComputeOptions* options, ComputeStats* stats);
+
+// Rolling correlation between every pair of symbols. kline holds symbol_count
+// time aligned series of time_count candles laid out [symbol][time], like the
+// cross-sectional jobs. The returns close[t] / close[t - 1] - 1 of each pair are
+// correlated over windows of correlation->window bars ending on bars window,
+// window + step, ..., GetCorrelationMatrixCount of them. The window sums slide
+// one bar at a time instead of being summed again for every window.
+//
+// Either matrices receives, per window, the full symbol_count x symbol_count
+// matrix laid out [window][symbol][symbol], or pairs receives the pairs whose
+// absolute correlation reaches correlation->threshold, sorted by time, first and
+// second. *pair_count holds the capacity of pairs on input and the number of pairs
+// found on output; when that exceeds the capacity only a subset of them was stored.
+// Flat windows have a correlation of 0. The device always stores 32 bit values.
+typedef struct CorrelationOptions
+{
+    uint32_t window; // Bars per window, at least 2
+    uint32_t step; // Bars between two windows, 0 is taken as 1
+    float threshold; // Smallest absolute correlation reported in pairs
+    uint32_t covariance; // Non zero fills matrices with population covariances instead
+} CorrelationOptions;
+
+typedef struct CorrelationPair
+{
+    uint32_t first;
+    uint32_t second; // Above first
+    uint32_t time; // Bar the window ends on
+    float correlation;
+} CorrelationPair;
+
+size_t GetCorrelationMatrixCount(size_t time_count, uint32_t window, uint32_t step);
+void SortCorrelationPairs(CorrelationPair* pairs, size_t count); // By time, first and second
+int ComputeRollingCorrelation(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const CorrelationOptions* correlation,
+                              float* matrices, CorrelationPair* pairs, uint32_t* pair_count, const ComputeOptions* options, ComputeStats* stats);
+int ComputeRollingCorrelationCpu(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const CorrelationOptions* correlation,
+                                 float* matrices, CorrelationPair* pairs, uint32_t* pair_count, const ComputeOptions* options, ComputeStats* stats);
+
+// Moving average crossover sweeps. For every (fast, slow) pair the strategy is long
+// while the fast simple moving average of the closes is above the slow one and short
+// while it is below, switching at the close of the bar where they cross and earning
+// the next bar's return. The averages are plain SMAs computed from one prefix sum
+// shared by all pairs, and only a summary per pair comes back. Runs on
+// options->threadCount CPU threads, one per core when 0; the other options are unused.
+typedef struct BacktestPair
+{
+    uint32_t fast;
+    uint32_t slow; // Above fast and below the number of candles
+} BacktestPair;
+
+typedef struct BacktestSummary
+{
+    double pnl; // Sum of the per bar returns, i.e. the profit of a constant notional of 1
+    double sharpe; // Mean over standard deviation of the per bar returns, not annualized
+    double maxDrawdown; // Largest drop of the cumulative pnl from its running peak
+    uint32_t trades; // Position changes, the first entry included
+    uint32_t bars; // Bars traded, from the first slow average on
+} BacktestSummary;
+
+int RunCrossoverSweep(const Candlestick* kline, size_t kline_elements_count, const BacktestPair* pairs, uint32_t pair_count,
+                      BacktestSummary* summaries, const ComputeOptions* options, ComputeStats* stats);
+
+// Streaming SMA jobs over a series that arrives in consecutive chunks of up to
+// chunk_capacity candles, e.g. while a file is still being uploaded. The device,
+// its buffers and pipelines are created once by OpenComputeStream and reused by
+// every push. Each chunk is computed after the STREAM_HALO(period) candles pushed
+// before it, so output receives, for the candles of the chunk, the same SMA a
+// single job over the whole series gives (up to float rounding on the device).
+// The candles are copied during the push, the caller may reuse them right away.
+// A stream is used by one thread at a time.
+#define STREAM_HALO(period) ((size_t)(period) + 1)
+
+typedef struct ComputeStream ComputeStream;
+
+int OpenComputeStream(size_t chunk_capacity, const ComputeOptions* options, ComputeStream** stream, ComputeStats* stats);
+int PushComputeStream(ComputeStream* stream, const Candlestick* kline, size_t kline_elements_count, Indicator* output, ComputeStats* stats);
+void CloseComputeStream(ComputeStream* stream);
+// Starts a new series on an open stream, the next push is computed without a halo.
+void ResetComputeStream(ComputeStream* stream);
+
+// Out of process computation through computesample-daemon, which keeps its devices
+// and pipelines open across jobs and clients and whose driver faults do not reach
+// the caller. The candles and results go through a shared memory ring of the
+// connection, chunk by chunk, so copying the next chunk in overlaps the computation
+// of the previous ones. socket_path NULL connects to $XDG_RUNTIME_DIR/computesample.sock
+// (/tmp without a runtime directory). ComputeResultDaemon computes the SMA of a new
+// series, ContinueResultDaemon extends the series of the previous call on the same
+// connection, like PushComputeStream. Both return 1 once the daemon is gone, the
+// connection then only needs to be closed. CheckComputeDaemon tells, without waiting,
+// whether an idle connection still has its daemon, 1 when it is gone. A connection is
+// used by one thread at a time.
+typedef struct ComputeDaemon ComputeDaemon;
+
+int ConnectComputeDaemon(const char* socket_path, ComputeDaemon** daemon);
+int CheckComputeDaemon(ComputeDaemon* daemon);
+int ComputeResultDaemon(ComputeDaemon* daemon, const Candlestick* kline, size_t kline_elements_count, Indicator* output,
+                        const ComputeOptions* options, ComputeStats* stats);
+int ContinueResultDaemon(ComputeDaemon* daemon, const Candlestick* kline, size_t kline_elements_count, Indicator* output, ComputeStats* stats);
+void DisconnectComputeDaemon(ComputeDaemon* daemon);
+
+// Range queries over a raw Candlestick file (like sample.dat) for chart windows.
+// OpenRangeIndex maps the candle file and its index, index_path NULL meaning
+// <candle_path>.idx, and builds the index first when it is missing or older than
+// the candles. The index keeps the prefix sums of the closes in doubles and the
+// lowest low and highest high of every block_size candles (0 for
+// RANGE_INDEX_DEFAULT_BLOCK, or whatever an existing index was built with), so a
+// query costs O(to - from + block_size) whatever the length of the series, and
+// only reads the pages around its window. Ranges are [from, to). QueryRangeSma
+// writes the SMA ComputeResult gives for those candles, up to float rounding.
+// Queries may run concurrently on one index.
+#define RANGE_INDEX_DEFAULT_BLOCK 1024
+
+typedef struct RangeIndex RangeIndex;
+
+typedef struct RangeSummary
+{
+    double meanClose;
+    float low; // Lowest low
+    float high; // Highest high
+} RangeSummary;
+
+int OpenRangeIndex(const char* candle_path, const char* index_path, uint32_t block_size, RangeIndex** index);
+size_t GetRangeIndexCount(const RangeIndex* index);
+int QueryRangeSma(const RangeIndex* index, uint32_t period, size_t from, size_t to, float* output);
+int QueryRangeSummary(const RangeIndex* index, size_t from, size_t to, RangeSummary* summary);
+void CloseRangeIndex(RangeIndex* index);
+
+// Enumerates the Vulkan physical devices available to ComputeOptions.deviceIndex.
+uint32_t GetComputeDeviceCount(void);
+int GetComputeDeviceName(uint32_t index, char* name, size_t name_length);
+
+double ComputeTimestampMs(void);
+
+#endif
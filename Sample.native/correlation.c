@@ -0,0 +1,392 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_HAS_X86_SIMD 1
+#endif
+#include "computesample.h"
+
+// Rolling correlation on the CPU, mirroring correlation_shader.comp. The returns are
+// transposed to [bar][symbol] so that consecutive symbols at one bar are a single
+// vector load, and the pairs are cut into blocks of CORRELATION_ROWS x
+// CORRELATION_LANES that walk the bars with their window sums of products held in
+// registers. Bars are walked in tiles so that a tile of returns stays in cache while
+// every block of a thread goes over it. Means and variances only depend on one
+// symbol, each thread keeps them for all symbols instead of once per pair.
+
+#define CORRELATION_ROWS 4
+#define CORRELATION_LANES 8
+#define CORRELATION_TILE_BARS 64
+
+// Adds bars [begin, end) to the window sums of the products of the block of pairs
+// (first + row, second + lane). Bar t is row t + window of returns and the rows
+// before bar 0 are zeros, so row t always holds the bar leaving the window.
+typedef void (*CorrelationBlockFunction)(const float* returns, size_t stride, uint32_t window, size_t first, size_t second,
+                                         size_t begin, size_t end, float products[CORRELATION_ROWS][CORRELATION_LANES]);
+
+typedef struct CorrelationShared
+{
+    CorrelationBlockFunction kernel;
+    const float* returns;
+    size_t stride; // Symbols rounded up to CORRELATION_LANES
+    uint32_t symbolCount;
+    uint32_t window;
+    uint32_t step;
+    size_t lastBar;
+    float threshold;
+    bool covariance;
+    float* products; // [symbol][stride] window sums, every row belongs to a single thread
+    float* matrices; // NULL when collecting pairs
+} CorrelationShared;
+
+typedef struct CorrelationWorker
+{
+    pthread_t thread;
+    const CorrelationShared* shared;
+    uint32_t firstBlock;
+    uint32_t blockStep;
+    // Window sums of every symbol and the moments of the windows ending in the current tile.
+    double* sums;
+    double* squares;
+    float* means; // [window in tile][stride]
+    float* deviations;
+    CorrelationPair* pairs;
+    size_t pairCount;
+    size_t pairCapacity;
+    int result;
+} CorrelationWorker;
+
+size_t GetCorrelationMatrixCount(size_t time_count, uint32_t window, uint32_t step)
+{
+    if (window == 0 || time_count <= window)
+        return 0;
+    step = step == 0 ? 1 : step;
+    return (time_count - 1 - window) / step + 1;
+}
+
+static void CorrelationBlockScalar(const float* returns, size_t stride, uint32_t window, size_t first, size_t second,
+                                   size_t begin, size_t end, float products[CORRELATION_ROWS][CORRELATION_LANES])
+{
+    for (size_t t = begin; t < end; ++t)
+    {
+        const float* entering = returns + (t + window) * stride;
+        const float* leaving = returns + t * stride;
+        for (int r = 0; r < CORRELATION_ROWS; ++r)
+        {
+            for (int l = 0; l < CORRELATION_LANES; ++l)
+                products[r][l] += entering[first + r] * entering[second + l] - leaving[first + r] * leaving[second + l];
+        }
+    }
+}
+
+#ifdef CPU_HAS_X86_SIMD
+// One register per row of the block, the returns of the second symbols are loaded
+// once per bar and multiplied by each broadcast first symbol.
+__attribute__((target("avx2")))
+static void CorrelationBlockAvx2(const float* returns, size_t stride, uint32_t window, size_t first, size_t second,
+                                 size_t begin, size_t end, float products[CORRELATION_ROWS][CORRELATION_LANES])
+{
+    __m256 sums[CORRELATION_ROWS];
+    for (int r = 0; r < CORRELATION_ROWS; ++r)
+        sums[r] = _mm256_loadu_ps(products[r]);
+    for (size_t t = begin; t < end; ++t)
+    {
+        const float* entering = returns + (t + window) * stride;
+        const float* leaving = returns + t * stride;
+        __m256 enteringSecond = _mm256_loadu_ps(&entering[second]);
+        __m256 leavingSecond = _mm256_loadu_ps(&leaving[second]);
+        for (int r = 0; r < CORRELATION_ROWS; ++r)
+        {
+            __m256 added = _mm256_mul_ps(_mm256_set1_ps(entering[first + r]), enteringSecond);
+            __m256 removed = _mm256_mul_ps(_mm256_set1_ps(leaving[first + r]), leavingSecond);
+            sums[r] = _mm256_add_ps(sums[r], _mm256_sub_ps(added, removed));
+        }
+    }
+    for (int r = 0; r < CORRELATION_ROWS; ++r)
+        _mm256_storeu_ps(products[r], sums[r]);
+}
+#endif
+
+static CorrelationBlockFunction SelectCorrelationKernel(void)
+{
+#ifdef CPU_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CorrelationBlockAvx2;
+#endif
+    return CorrelationBlockScalar;
+}
+
+// Slides the window sums of every symbol over bars [begin, end) and keeps the mean
+// and standard deviation of each window ending there. Returns the number of windows.
+static size_t UpdateMoments(CorrelationWorker* worker, size_t begin, size_t end, size_t* windowEnds)
+{
+    const CorrelationShared* shared = worker->shared;
+    size_t count = 0;
+    for (size_t t = begin; t < end; ++t)
+    {
+        const float* entering = shared->returns + (t + shared->window) * shared->stride;
+        const float* leaving = shared->returns + t * shared->stride;
+        for (uint32_t s = 0; s < shared->symbolCount; ++s)
+        {
+            worker->sums[s] += (double)entering[s] - leaving[s];
+            worker->squares[s] += (double)entering[s] * entering[s] - (double)leaving[s] * leaving[s];
+        }
+        if (t < shared->window || (t - shared->window) % shared->step != 0)
+            continue;
+        float* means = worker->means + count * shared->stride;
+        float* deviations = worker->deviations + count * shared->stride;
+        for (uint32_t s = 0; s < shared->symbolCount; ++s)
+        {
+            double mean = worker->sums[s] / shared->window;
+            double variance = worker->squares[s] / shared->window - mean * mean;
+            means[s] = (float)mean;
+            deviations[s] = variance > 0 ? (float)sqrt(variance) : 0;
+        }
+        windowEnds[count++] = t;
+    }
+    return count;
+}
+
+static bool AppendPair(CorrelationWorker* worker, CorrelationPair pair)
+{
+    if (worker->pairCount == worker->pairCapacity)
+    {
+        size_t capacity = worker->pairCapacity == 0 ? 1024 : worker->pairCapacity * 2;
+        CorrelationPair* pairs = (CorrelationPair*)realloc(worker->pairs, capacity * sizeof(CorrelationPair));
+        if (pairs == NULL)
+            return false;
+        worker->pairs = pairs;
+        worker->pairCapacity = capacity;
+    }
+    worker->pairs[worker->pairCount++] = pair;
+    return true;
+}
+
+// Writes the block's pairs for the window ending on bar time, the tile's index-th window.
+static bool EmitBlock(CorrelationWorker* worker, size_t index, size_t time, size_t first, size_t second,
+                      float products[CORRELATION_ROWS][CORRELATION_LANES])
+{
+    const CorrelationShared* shared = worker->shared;
+    const float* means = worker->means + index * shared->stride;
+    const float* deviations = worker->deviations + index * shared->stride;
+    size_t symbols = shared->symbolCount;
+    size_t matrix = (time - shared->window) / shared->step;
+    for (size_t i = first; i < first + CORRELATION_ROWS && i < symbols; ++i)
+    {
+        for (size_t j = second > i ? second : i; j < second + CORRELATION_LANES && j < symbols; ++j)
+        {
+            float covariance = products[i - first][j - second] / shared->window - means[i] * means[j];
+            float correlation = 0;
+            if (deviations[i] > 0 && deviations[j] > 0)
+            {
+                correlation = covariance / (deviations[i] * deviations[j]);
+                correlation = correlation > 1 ? 1 : (correlation < -1 ? -1 : correlation);
+            }
+            if (shared->matrices != NULL)
+            {
+                float value = shared->covariance ? covariance : correlation;
+                shared->matrices[(matrix * symbols + i) * symbols + j] = value;
+                shared->matrices[(matrix * symbols + j) * symbols + i] = value;
+            }
+            else if (i < j && fabsf(correlation) >= shared->threshold &&
+                     !AppendPair(worker, (CorrelationPair){ .first = (uint32_t)i, .second = (uint32_t)j, .time = (uint32_t)time, .correlation = correlation }))
+                return false;
+        }
+    }
+    return true;
+}
+
+static void* CorrelationWorkerMain(void* argument)
+{
+    CorrelationWorker* worker = (CorrelationWorker*)argument;
+    const CorrelationShared* shared = worker->shared;
+    size_t stride = shared->stride;
+    size_t windowEnds[CORRELATION_TILE_BARS];
+    for (size_t base = 0; base <= shared->lastBar; base += CORRELATION_TILE_BARS)
+    {
+        size_t end = base + CORRELATION_TILE_BARS <= shared->lastBar + 1 ? base + CORRELATION_TILE_BARS : shared->lastBar + 1;
+        size_t windowCount = UpdateMoments(worker, base, end, windowEnds);
+        for (size_t first = (size_t)worker->firstBlock * CORRELATION_ROWS; first < shared->symbolCount; first += (size_t)worker->blockStep * CORRELATION_ROWS)
+        {
+            // Only the blocks reaching the diagonal or above it, the matrices are symmetric.
+            for (size_t second = first / CORRELATION_LANES * CORRELATION_LANES; second < shared->symbolCount; second += CORRELATION_LANES)
+            {
+                float products[CORRELATION_ROWS][CORRELATION_LANES];
+                for (int r = 0; r < CORRELATION_ROWS; ++r)
+                    memcpy(products[r], shared->products + (first + r) * stride + second, sizeof(products[r]));
+                size_t t = base;
+                for (size_t w = 0; w < windowCount; ++w)
+                {
+                    shared->kernel(shared->returns, stride, shared->window, first, second, t, windowEnds[w] + 1, products);
+                    if (!EmitBlock(worker, w, windowEnds[w], first, second, products))
+                    {
+                        worker->result = 1;
+                        return NULL;
+                    }
+                    t = windowEnds[w] + 1;
+                }
+                shared->kernel(shared->returns, stride, shared->window, first, second, t, end, products);
+                for (int r = 0; r < CORRELATION_ROWS; ++r)
+                    memcpy(shared->products + (first + r) * stride + second, products[r], sizeof(products[r]));
+            }
+        }
+    }
+    return NULL;
+}
+
+static int ComparePairs(const void* a, const void* b)
+{
+    const CorrelationPair* x = (const CorrelationPair*)a;
+    const CorrelationPair* y = (const CorrelationPair*)b;
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+    if (x->first != y->first)
+        return x->first < y->first ? -1 : 1;
+    return (x->second > y->second) - (x->second < y->second);
+}
+
+void SortCorrelationPairs(CorrelationPair* pairs, size_t count)
+{
+    qsort(pairs, count, sizeof(CorrelationPair), ComparePairs);
+}
+
+// Sorts the pairs found by every worker and keeps as many as pairs can hold.
+static int MergePairs(CorrelationWorker* workers, uint32_t workerCount, CorrelationPair* pairs, uint32_t* pair_count)
+{
+    size_t total = 0;
+    for (uint32_t w = 0; w < workerCount; ++w)
+        total += workers[w].pairCount;
+    CorrelationPair* merged = (CorrelationPair*)malloc((total > 0 ? total : 1) * sizeof(CorrelationPair));
+    if (merged == NULL)
+        return 1;
+    size_t offset = 0;
+    for (uint32_t w = 0; w < workerCount; ++w)
+    {
+        memcpy(merged + offset, workers[w].pairs, workers[w].pairCount * sizeof(CorrelationPair));
+        offset += workers[w].pairCount;
+    }
+    SortCorrelationPairs(merged, total);
+    size_t stored = total < *pair_count ? total : *pair_count;
+    if (stored > 0)
+        memcpy(pairs, merged, stored * sizeof(CorrelationPair));
+    *pair_count = total < UINT32_MAX ? (uint32_t)total : UINT32_MAX;
+    free(merged);
+    return 0;
+}
+
+int ComputeRollingCorrelationCpu(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const CorrelationOptions* correlation,
+                                 float* matrices, CorrelationPair* pairs, uint32_t* pair_count, const ComputeOptions* options, ComputeStats* stats)
+{
+    ComputeOptions defaults = { .backend = COMPUTE_BACKEND_CPU_THREADED };
+    if (options == NULL)
+        options = &defaults;
+    uint32_t step = correlation->step == 0 ? 1 : correlation->step;
+    size_t matrixCount = GetCorrelationMatrixCount(time_count, correlation->window, step);
+    if (matrixCount == 0)
+        return 1;
+    uint32_t blockCount = (symbol_count + CORRELATION_ROWS - 1) / CORRELATION_ROWS;
+    uint32_t threadCount = 1;
+    CorrelationBlockFunction kernel = SelectCorrelationKernel();
+    switch (options->backend)
+    {
+    case COMPUTE_BACKEND_CPU_SCALAR:
+        kernel = CorrelationBlockScalar;
+        break;
+    case COMPUTE_BACKEND_CPU_SIMD:
+        break;
+    case COMPUTE_BACKEND_CPU_THREADED:
+        threadCount = options->threadCount;
+        if (threadCount == 0)
+        {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            threadCount = online > 0 ? (uint32_t)online : 1;
+        }
+        threadCount = threadCount < blockCount ? threadCount : blockCount;
+        break;
+    default:
+        return 1;
+    }
+
+    double start = ComputeTimestampMs();
+    CorrelationShared shared = {
+        .kernel = kernel,
+        .stride = (symbol_count + CORRELATION_LANES - 1) / CORRELATION_LANES * CORRELATION_LANES,
+        .symbolCount = symbol_count,
+        .window = correlation->window,
+        .step = step,
+        .lastBar = correlation->window + (matrixCount - 1) * step,
+        .threshold = correlation->threshold,
+        .covariance = correlation->covariance != 0,
+        .matrices = matrices
+    };
+    // Window rows of zeros precede bar 0, see CorrelationBlockFunction.
+    float* returns = (float*)calloc((shared.window + shared.lastBar + 1) * shared.stride, sizeof(float));
+    float* products = (float*)calloc(shared.stride * shared.stride, sizeof(float));
+    CorrelationWorker* workers = (CorrelationWorker*)calloc(threadCount, sizeof(CorrelationWorker));
+    int result = returns == NULL || products == NULL || workers == NULL;
+    for (uint32_t t = 0; t < threadCount && result == 0; ++t)
+    {
+        workers[t] = (CorrelationWorker){
+            .shared = &shared,
+            .firstBlock = t,
+            .blockStep = threadCount,
+            .sums = (double*)calloc(symbol_count, sizeof(double)),
+            .squares = (double*)calloc(symbol_count, sizeof(double)),
+            .means = (float*)malloc(CORRELATION_TILE_BARS * shared.stride * sizeof(float)),
+            .deviations = (float*)malloc(CORRELATION_TILE_BARS * shared.stride * sizeof(float))
+        };
+        result = workers[t].sums == NULL || workers[t].squares == NULL || workers[t].means == NULL || workers[t].deviations == NULL;
+    }
+
+    if (result == 0)
+    {
+        for (uint32_t s = 0; s < symbol_count; ++s)
+        {
+            const Candlestick* series = kline + (size_t)s * time_count;
+            for (size_t t = 1; t <= shared.lastBar; ++t)
+                returns[(t + shared.window) * shared.stride + s] = series[t - 1].close != 0 ? (float)((double)series[t].close / series[t - 1].close - 1.0) : 0;
+        }
+        shared.returns = returns;
+        shared.products = products;
+
+        // Blocks are dealt out in turn, later blocks have fewer pairs right of the diagonal.
+        uint32_t started = 0;
+        for (uint32_t t = 1; t < threadCount; ++t)
+        {
+            if (pthread_create(&workers[t].thread, NULL, CorrelationWorkerMain, &workers[t]) != 0)
+                break;
+            started = t;
+        }
+        CorrelationWorkerMain(&workers[0]);
+        for (uint32_t t = 1; t <= started; ++t)
+            pthread_join(workers[t].thread, NULL);
+        // Any share whose thread failed to start is finished here.
+        for (uint32_t t = started + 1; t < threadCount; ++t)
+            CorrelationWorkerMain(&workers[t]);
+        for (uint32_t t = 0; t < threadCount; ++t)
+            result |= workers[t].result;
+        if (result == 0 && matrices == NULL)
+            result = MergePairs(workers, threadCount, pairs, pair_count);
+    }
+
+    for (uint32_t t = 0; workers != NULL && t < threadCount; ++t)
+    {
+        free(workers[t].sums);
+        free(workers[t].squares);
+        free(workers[t].means);
+        free(workers[t].deviations);
+        free(workers[t].pairs);
+    }
+    free(workers);
+    free(products);
+    free(returns);
+    if (result == 0 && stats != NULL)
+        *stats = (ComputeStats){ .computeMs = ComputeTimestampMs() - start };
+    return result;
+}
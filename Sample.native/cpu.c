@@ -0,0 +1,419 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_HAS_X86_SIMD 1
+#endif
+#include "computesample.h"
+
+// CPU implementations of the SMA indicator. They mirror the two Vulkan passes so the
+// results can be compared against the shaders:
+//   pass 1: sma[x] = sum(close[x - PERIOD + 1 .. x]) / PERIOD, or 1 when x < PERIOD
+//   pass 2: sma[x] = sma[x] - sma[x - 1] / PERIOD for x >= PERIOD
+
+#define CPU_BLOCK_SIZE 4096
+// Longer windows use the sequential rolling sum, which beats the vector direct sum past this.
+#define CPU_DIRECT_WINDOW_LIMIT 32
+
+typedef void (*SmaRangeFunction)(const Candlestick* kline, Indicator* output, size_t begin, size_t end, uint32_t period);
+
+double ComputeTimestampMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static inline float FirstPassAt(const Candlestick* kline, size_t x, uint32_t period)
+{
+    if (x < period)
+        return 1;
+    float sum = kline[x].close;
+    for (uint32_t i = 1; i < period; ++i)
+        sum += kline[x - i].close;
+    return sum / period;
+}
+
+static void SmaRangeScalar(const Candlestick* kline, Indicator* output, size_t begin, size_t end, uint32_t period)
+{
+    size_t x = begin;
+    for (; x < end && x < period; ++x)
+        output[x] = (Indicator){ .sma = 1 };
+    if (x >= end)
+        return;
+
+    // Rolling window sum, seeded with the window ending at x - 1.
+    double sum = 0;
+    for (size_t i = x - period; i < x; ++i)
+        sum += kline[i].close;
+    float previous = (x - 1 < period) ? 1 : (float)(sum / period);
+    for (; x < end; ++x)
+    {
+        sum += kline[x].close - kline[x - period].close;
+        float current = (float)(sum / period);
+        output[x] = (Indicator){ .sma = current - previous / period };
+        previous = current;
+    }
+}
+
+#ifdef CPU_HAS_X86_SIMD
+// Both vector kernels work on blocks: the close prices for the block (plus the
+// PERIOD - 1 window halo and one extra element for pass 2) are gathered into a
+// contiguous array, then the window sums are accumulated lane-parallel in the
+// same order as the shader does.
+static void SmaRangeSse(const Candlestick* kline, Indicator* output, size_t begin, size_t end, uint32_t period)
+{
+    float closes[CPU_BLOCK_SIZE + CPU_DIRECT_WINDOW_LIMIT + 4];
+    float firstPass[CPU_BLOCK_SIZE + 1 + 4];
+    __m128 divisor = _mm_set1_ps((float)period);
+
+    if (period > CPU_DIRECT_WINDOW_LIMIT)
+    {
+        SmaRangeScalar(kline, output, begin, end, period);
+        return;
+    }
+
+    size_t x = begin;
+    for (; x < end && x < period; ++x)
+        output[x] = (Indicator){ .sma = 1 };
+
+    while (x < end)
+    {
+        size_t count = end - x < CPU_BLOCK_SIZE ? end - x : CPU_BLOCK_SIZE;
+        // firstPass[j] holds pass 1 for index x - 1 + j
+        size_t first = x - 1;
+        size_t windowStart = first + 1 - period;
+        size_t closeCount = count + period;
+        for (size_t j = 0; j < closeCount; ++j)
+            closes[j] = kline[windowStart + j].close;
+        size_t j = 0;
+        for (; j + 4 <= count + 1; j += 4)
+        {
+            __m128 sum = _mm_loadu_ps(&closes[j + period - 1]);
+            for (uint32_t i = 1; i < period; ++i)
+                sum = _mm_add_ps(sum, _mm_loadu_ps(&closes[j + period - 1 - i]));
+            _mm_storeu_ps(&firstPass[j], _mm_div_ps(sum, divisor));
+        }
+        for (; j <= count; ++j)
+            firstPass[j] = FirstPassAt(kline, first + j, period);
+        if (first < period)
+            firstPass[0] = 1;
+
+        j = 0;
+        for (; j + 4 <= count; j += 4)
+        {
+            __m128 current = _mm_loadu_ps(&firstPass[j + 1]);
+            __m128 previous = _mm_loadu_ps(&firstPass[j]);
+            __m128 sma = _mm_sub_ps(current, _mm_div_ps(previous, divisor));
+            // Scatter into the Indicator array with zeroed padding.
+            __m128 zero = _mm_setzero_ps();
+            __m128 lo = _mm_unpacklo_ps(sma, zero);
+            __m128 hi = _mm_unpackhi_ps(sma, zero);
+            _mm_storeu_ps((float*)&output[x + j + 0], _mm_movelh_ps(lo, zero));
+            _mm_storeu_ps((float*)&output[x + j + 1], _mm_movehl_ps(zero, lo));
+            _mm_storeu_ps((float*)&output[x + j + 2], _mm_movelh_ps(hi, zero));
+            _mm_storeu_ps((float*)&output[x + j + 3], _mm_movehl_ps(zero, hi));
+        }
+        for (; j < count; ++j)
+            output[x + j] = (Indicator){ .sma = firstPass[j + 1] - firstPass[j] / period };
+        x += count;
+    }
+}
+
+__attribute__((target("avx2")))
+static void SmaRangeAvx2(const Candlestick* kline, Indicator* output, size_t begin, size_t end, uint32_t period)
+{
+    float closes[CPU_BLOCK_SIZE + CPU_DIRECT_WINDOW_LIMIT + 8];
+    float firstPass[CPU_BLOCK_SIZE + 1 + 8];
+    __m256 divisor = _mm256_set1_ps((float)period);
+    // Gathers the close column out of 8 consecutive 16 byte Candlesticks.
+    __m256i closeIndex = _mm256_setr_epi32(3, 7, 11, 15, 19, 23, 27, 31);
+
+    if (period > CPU_DIRECT_WINDOW_LIMIT)
+    {
+        SmaRangeScalar(kline, output, begin, end, period);
+        return;
+    }
+
+    size_t x = begin;
+    for (; x < end && x < period; ++x)
+        output[x] = (Indicator){ .sma = 1 };
+
+    while (x < end)
+    {
+        size_t count = end - x < CPU_BLOCK_SIZE ? end - x : CPU_BLOCK_SIZE;
+        size_t first = x - 1;
+        size_t windowStart = first + 1 - period;
+        size_t closeCount = count + period;
+        size_t j = 0;
+        for (; j + 8 <= closeCount; j += 8)
+            _mm256_storeu_ps(&closes[j], _mm256_i32gather_ps((const float*)&kline[windowStart + j], closeIndex, 4));
+        for (; j < closeCount; ++j)
+            closes[j] = kline[windowStart + j].close;
+        j = 0;
+        for (; j + 8 <= count + 1; j += 8)
+        {
+            __m256 sum = _mm256_loadu_ps(&closes[j + period - 1]);
+            for (uint32_t i = 1; i < period; ++i)
+                sum = _mm256_add_ps(sum, _mm256_loadu_ps(&closes[j + period - 1 - i]));
+            _mm256_storeu_ps(&firstPass[j], _mm256_div_ps(sum, divisor));
+        }
+        for (; j <= count; ++j)
+            firstPass[j] = FirstPassAt(kline, first + j, period);
+        if (first < period)
+            firstPass[0] = 1;
+
+        j = 0;
+        for (; j + 8 <= count; j += 8)
+        {
+            __m256 current = _mm256_loadu_ps(&firstPass[j + 1]);
+            __m256 previous = _mm256_loadu_ps(&firstPass[j]);
+            __m256 sma = _mm256_sub_ps(current, _mm256_div_ps(previous, divisor));
+            __m128 zero = _mm_setzero_ps();
+            __m128 halves[2] = { _mm256_castps256_ps128(sma), _mm256_extractf128_ps(sma, 1) };
+            for (int h = 0; h < 2; ++h)
+            {
+                __m128 lo = _mm_unpacklo_ps(halves[h], zero);
+                __m128 hi = _mm_unpackhi_ps(halves[h], zero);
+                Indicator* dst = &output[x + j + h * 4];
+                _mm_storeu_ps((float*)&dst[0], _mm_movelh_ps(lo, zero));
+                _mm_storeu_ps((float*)&dst[1], _mm_movehl_ps(zero, lo));
+                _mm_storeu_ps((float*)&dst[2], _mm_movelh_ps(hi, zero));
+                _mm_storeu_ps((float*)&dst[3], _mm_movehl_ps(zero, hi));
+            }
+        }
+        for (; j < count; ++j)
+            output[x + j] = (Indicator){ .sma = firstPass[j + 1] - firstPass[j] / period };
+        x += count;
+    }
+}
+#endif
+
+static SmaRangeFunction SelectSimdKernel(void)
+{
+#ifdef CPU_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SmaRangeAvx2;
+    return SmaRangeSse;
+#else
+    return SmaRangeScalar;
+#endif
+}
+
+typedef struct CpuWorker
+{
+    pthread_t thread;
+    SmaRangeFunction kernel;
+    const Candlestick* kline;
+    Indicator* output;
+    size_t begin;
+    size_t end;
+    uint32_t period;
+} CpuWorker;
+
+static void* CpuWorkerMain(void* argument)
+{
+    CpuWorker* worker = (CpuWorker*)argument;
+    worker->kernel(worker->kline, worker->output, worker->begin, worker->end, worker->period);
+    return NULL;
+}
+
+static int SmaRangeThreaded(const Candlestick* kline, Indicator* output, size_t count, uint32_t period, uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = online > 0 ? (uint32_t)online : 1;
+    }
+    // Not worth waking threads for less than a few blocks per thread.
+    size_t maxThreads = count / (CPU_BLOCK_SIZE * 4) + 1;
+    if (threadCount > maxThreads)
+        threadCount = (uint32_t)maxThreads;
+
+    SmaRangeFunction kernel = SelectSimdKernel();
+    CpuWorker* workers = (CpuWorker*)calloc(threadCount, sizeof(CpuWorker));
+    if (workers == NULL)
+        return 1;
+
+    size_t chunk = (count + threadCount - 1) / threadCount;
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        workers[t] = (CpuWorker){
+            .kernel = kernel,
+            .kline = kline,
+            .output = output,
+            .begin = t * chunk < count ? t * chunk : count,
+            .end = (t + 1) * chunk < count ? (t + 1) * chunk : count,
+            .period = period
+        };
+    }
+    // The calling thread takes the first chunk itself.
+    uint32_t started = 0;
+    for (uint32_t t = 1; t < threadCount; ++t)
+    {
+        if (pthread_create(&workers[t].thread, NULL, CpuWorkerMain, &workers[t]) != 0)
+            break;
+        started = t;
+    }
+    CpuWorkerMain(&workers[0]);
+    for (uint32_t t = 1; t <= started; ++t)
+        pthread_join(workers[t].thread, NULL);
+    // Any chunk whose thread failed to start is finished here.
+    for (uint32_t t = started + 1; t < threadCount; ++t)
+        CpuWorkerMain(&workers[t]);
+    free(workers);
+    return 0;
+}
+
+int ComputeResultCpu(const Candlestick* kline, size_t kline_elements_count, Indicator* output, const ComputeOptions* options, ComputeStats* stats)
+{
+    if (output == NULL || kline == NULL || kline_elements_count <= 0)
+        return 1;
+    ComputeOptions defaults = { .backend = COMPUTE_BACKEND_CPU_THREADED };
+    if (options == NULL)
+        options = &defaults;
+    uint32_t period = options->period == 0 ? SMA_DEFAULT_PERIOD : options->period;
+
+    double start = ComputeTimestampMs();
+    int result = 0;
+    switch (options->backend)
+    {
+    case COMPUTE_BACKEND_CPU_SCALAR:
+        SmaRangeScalar(kline, output, 0, kline_elements_count, period);
+        break;
+    case COMPUTE_BACKEND_CPU_SIMD:
+        SelectSimdKernel()(kline, output, 0, kline_elements_count, period);
+        break;
+    case COMPUTE_BACKEND_CPU_THREADED:
+        result = SmaRangeThreaded(kline, output, kline_elements_count, period, options->threadCount);
+        break;
+    default:
+        return 1;
+    }
+
+    if (stats != NULL)
+    {
+        // Host memory is shared, so there is no setup, upload or readback stage.
+        *stats = (ComputeStats){ .computeMs = ComputeTimestampMs() - start };
+    }
+    return result;
+}
+
+size_t GetResampledCount(size_t kline_elements_count, uint32_t timeframe)
+{
+    if (timeframe == 0)
+        return 0;
+    return (kline_elements_count + timeframe - 1) / timeframe;
+}
+
+void ResampleCandles(const Candlestick* kline, size_t kline_elements_count, uint32_t timeframe, Candlestick* resampled)
+{
+    size_t count = GetResampledCount(kline_elements_count, timeframe);
+    for (size_t x = 0; x < count; ++x)
+    {
+        size_t first = x * timeframe;
+        size_t last = first + timeframe < kline_elements_count ? first + timeframe - 1 : kline_elements_count - 1;
+        Candlestick candle = kline[first];
+        candle.close = kline[last].close;
+        for (size_t i = first + 1; i <= last; ++i)
+        {
+            candle.high = kline[i].high > candle.high ? kline[i].high : candle.high;
+            candle.low = kline[i].low < candle.low ? kline[i].low : candle.low;
+        }
+        resampled[x] = candle;
+    }
+}
+
+int ComputeResampledResultCpu(const Candlestick* kline, size_t kline_elements_count, const uint32_t* timeframes, uint32_t timeframe_count,
+                              Candlestick* resampled, Indicator* output, const ComputeOptions* options, ComputeStats* stats)
+{
+    double start = ComputeTimestampMs();
+    size_t offset = 0;
+    for (uint32_t t = 0; t < timeframe_count; ++t)
+    {
+        size_t count = GetResampledCount(kline_elements_count, timeframes[t]);
+        Candlestick* candles = resampled != NULL ? resampled + offset : (Candlestick*)malloc(count * sizeof(Candlestick));
+        if (candles == NULL)
+            return 1;
+        ResampleCandles(kline, kline_elements_count, timeframes[t], candles);
+        int result = ComputeResultCpu(candles, count, output + offset, options, NULL);
+        if (resampled == NULL)
+            free(candles);
+        if (result != 0)
+            return result;
+        offset += count;
+    }
+
+    if (stats != NULL)
+        *stats = (ComputeStats){ .computeMs = ComputeTimestampMs() - start };
+    return 0;
+}
+
+static int CompareFloats(const void* a, const void* b)
+{
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Index of the first element of sorted not below value, or above it when upper is set.
+static size_t SortedBound(const float* sorted, size_t count, float value, bool upper)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (upper ? sorted[middle] <= value : sorted[middle] < value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+int ComputeCrossSectionalResultCpu(const Candlestick* kline, uint32_t symbol_count, size_t time_count, Indicator* output, float* percentile,
+                                   const ComputeOptions* options, ComputeStats* stats)
+{
+    double start = ComputeTimestampMs();
+    for (uint32_t s = 0; s < symbol_count; ++s)
+    {
+        int result = ComputeResultCpu(kline + s * time_count, time_count, output + s * time_count, options, NULL);
+        if (result != 0)
+            return result;
+    }
+
+    if (percentile != NULL)
+    {
+        // Sorting each time once turns the counts below and equal into two binary searches per symbol.
+        float* sorted = (float*)malloc(symbol_count * sizeof(float));
+        if (sorted == NULL)
+            return 1;
+        for (size_t t = 0; t < time_count; ++t)
+        {
+            for (uint32_t s = 0; s < symbol_count; ++s)
+                sorted[s] = output[s * time_count + t].sma;
+            qsort(sorted, symbol_count, sizeof(float), CompareFloats);
+            for (uint32_t s = 0; s < symbol_count; ++s)
+            {
+                float value = output[s * time_count + t].sma;
+                size_t below = SortedBound(sorted, symbol_count, value, false);
+                size_t equal = SortedBound(sorted, symbol_count, value, true) - below;
+                percentile[s * time_count + t] = ((float)below + 0.5f * (float)equal) / (float)symbol_count;
+            }
+        }
+        free(sorted);
+    }
+
+    if (stats != NULL)
+        *stats = (ComputeStats){ .computeMs = ComputeTimestampMs() - start };
+    return 0;
+}
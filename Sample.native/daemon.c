@@ -0,0 +1,398 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+// Compute daemon, owns the devices and pipelines so that its clients do not have to.
+//
+// Usage: computesample-daemon [--socket path] [--chunk-candles 65536] [--slots 4]
+//                             [--idle-streams 4] [--max-clients 16]
+//
+// Clients connect with ConnectComputeDaemon and exchange candles and results
+// through a shared memory ring per connection, see daemon.h. Each series is
+// computed on a ComputeStream taking chunks of --chunk-candles candles; streams
+// go back to a pool when their series ends, so a later job with the same options,
+// from any client, runs on an open device with its pipelines already built.
+// Connections take turns one chunk at a time. Periods above --chunk-candles are
+// rejected. A driver fault ends the daemon and its clients see their jobs fail;
+// it is meant to run under a supervisor that restarts it.
+
+typedef struct DaemonConfig
+{
+    char socketPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    uint32_t chunkCapacity;
+    uint32_t slotCount;
+    uint32_t idleStreams;
+    uint32_t maxClients;
+} DaemonConfig;
+
+typedef struct PooledStream
+{
+    ComputeOptions options;
+    ComputeStream* stream;
+} PooledStream;
+
+typedef struct Client
+{
+    int socket;
+    int requestEvent;
+    int responseEvent;
+    DaemonRing* ring;
+    size_t size;
+    uint64_t processed;
+    // Stream of the current series, NULL before the first one and after a failed chunk.
+    ComputeStream* stream;
+    ComputeOptions streamOptions;
+} Client;
+
+typedef struct Daemon
+{
+    DaemonConfig config;
+    int listener;
+    Client* clients;
+    uint32_t clientCount;
+    PooledStream* idle; // Least recently used first
+    uint32_t idleCount;
+} Daemon;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void OnSignal(int number)
+{
+    (void)number;
+    stopping = 1;
+}
+
+static int ParseArguments(int argc, char** argv, DaemonConfig* config)
+{
+    *config = (DaemonConfig){
+        .chunkCapacity = 64 * 1024,
+        .slotCount = 4,
+        .idleStreams = 4,
+        .maxClients = 16
+    };
+    DaemonDefaultSocketPath(config->socketPath, sizeof(config->socketPath));
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return 1;
+        if (strcmp(argv[i], "--socket") == 0)
+        {
+            if (strlen(value) >= sizeof(config->socketPath))
+                return 1;
+            snprintf(config->socketPath, sizeof(config->socketPath), "%s", value);
+        }
+        else if (strcmp(argv[i], "--chunk-candles") == 0)
+            config->chunkCapacity = (uint32_t)strtod(value, NULL);
+        else if (strcmp(argv[i], "--slots") == 0)
+            config->slotCount = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--idle-streams") == 0)
+            config->idleStreams = (uint32_t)atoi(value);
+        else if (strcmp(argv[i], "--max-clients") == 0)
+            config->maxClients = (uint32_t)atoi(value);
+        else
+            return 1;
+    }
+    return config->chunkCapacity == 0 || config->slotCount == 0 || config->maxClients == 0 ? 1 : 0;
+}
+
+// The options of a slot come from the client, only sane ones reach the library.
+static bool NormalizeOptions(const DaemonConfig* config, ComputeOptions* options)
+{
+    if (options->period == 0)
+        options->period = SMA_DEFAULT_PERIOD;
+    return options->backend >= COMPUTE_BACKEND_VULKAN && options->backend <= COMPUTE_BACKEND_CPU_THREADED &&
+           options->period <= config->chunkCapacity && options->storagePrecision <= COMPUTE_PRECISION_FP16 &&
+           options->kernelVariant <= COMPUTE_KERNEL_SUBGROUP;
+}
+
+// Takes an idle stream opened with the same options, or opens one, whose setup lands in stats.
+static ComputeStream* AcquireStream(Daemon* daemon, const ComputeOptions* options, ComputeStats* stats)
+{
+    for (uint32_t i = daemon->idleCount; i-- > 0; )
+    {
+        if (memcmp(&daemon->idle[i].options, options, sizeof(ComputeOptions)) != 0)
+            continue;
+        ComputeStream* stream = daemon->idle[i].stream;
+        memmove(daemon->idle + i, daemon->idle + i + 1, (daemon->idleCount - i - 1) * sizeof(PooledStream));
+        --daemon->idleCount;
+        ResetComputeStream(stream);
+        return stream;
+    }
+    ComputeStream* stream = NULL;
+    if (OpenComputeStream(daemon->config.chunkCapacity, options, &stream, stats) != 0)
+        return NULL;
+    return stream;
+}
+
+// Ends the series of the client and pools its stream, closing the least recently used one when the pool is full.
+static void ReleaseStream(Daemon* daemon, Client* client)
+{
+    if (client->stream == NULL)
+        return;
+    if (daemon->config.idleStreams == 0)
+        CloseComputeStream(client->stream);
+    else
+    {
+        if (daemon->idleCount == daemon->config.idleStreams)
+        {
+            CloseComputeStream(daemon->idle[0].stream);
+            memmove(daemon->idle, daemon->idle + 1, (daemon->idleCount - 1) * sizeof(PooledStream));
+            --daemon->idleCount;
+        }
+        daemon->idle[daemon->idleCount++] = (PooledStream){ .options = client->streamOptions, .stream = client->stream };
+    }
+    client->stream = NULL;
+}
+
+static int SendHello(int socketFd, const DaemonHello* hello, const int fds[3])
+{
+    union
+    {
+        char buffer[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = (void*)hello, .iov_len = sizeof(*hello) };
+    struct msghdr message = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer) };
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(header), fds, 3 * sizeof(int));
+    return sendmsg(socketFd, &message, MSG_NOSIGNAL) == (ssize_t)sizeof(*hello) ? 0 : 1;
+}
+
+// Creates the ring of a new connection and hands it over. The memfd is sealed so
+// that the client cannot shrink it under the mapping of the daemon.
+static void AcceptClient(Daemon* daemon)
+{
+    int socketFd = accept4(daemon->listener, NULL, NULL, SOCK_CLOEXEC);
+    if (socketFd < 0)
+        return;
+    if (daemon->clientCount == daemon->config.maxClients)
+    {
+        fprintf(stderr, "refusing a client: %u connected already\n", daemon->clientCount);
+        close(socketFd);
+        return;
+    }
+
+    const DaemonConfig* config = &daemon->config;
+    DaemonHello hello = {
+        .magic = DAEMON_MAGIC,
+        .version = DAEMON_VERSION,
+        .chunkCapacity = config->chunkCapacity,
+        .slotCount = config->slotCount,
+        .size = DaemonRingSize(config->chunkCapacity, config->slotCount)
+    };
+    int fds[3] = {
+        memfd_create("computesample-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING),
+        eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK),
+        eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)
+    };
+    void* ring = MAP_FAILED;
+    if (fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 && ftruncate(fds[0], (off_t)hello.size) == 0 &&
+        fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+        ring = mmap(NULL, hello.size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (ring == MAP_FAILED || SendHello(socketFd, &hello, fds) != 0)
+    {
+        fprintf(stderr, "could not set up a client: %s\n", strerror(errno));
+        if (ring != MAP_FAILED)
+            munmap(ring, hello.size);
+        for (int i = 0; i < 3; ++i)
+        {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+        close(socketFd);
+        return;
+    }
+    close(fds[0]);
+    daemon->clients[daemon->clientCount++] = (Client){
+        .socket = socketFd,
+        .requestEvent = fds[1],
+        .responseEvent = fds[2],
+        .ring = (DaemonRing*)ring,
+        .size = hello.size
+    };
+}
+
+static void DropClient(Daemon* daemon, uint32_t index)
+{
+    Client* client = &daemon->clients[index];
+    ReleaseStream(daemon, client);
+    munmap(client->ring, client->size);
+    close(client->requestEvent);
+    close(client->responseEvent);
+    close(client->socket);
+    daemon->clients[index] = daemon->clients[--daemon->clientCount];
+}
+
+// Slots submitted by the client and not processed yet, -1 when the counter is out of range.
+static int64_t PendingSlots(const Daemon* daemon, Client* client)
+{
+    uint64_t submitted = atomic_load_explicit(&client->ring->submitted, memory_order_acquire);
+    if (submitted < client->processed || submitted - client->processed > daemon->config.slotCount)
+        return -1;
+    return (int64_t)(submitted - client->processed);
+}
+
+static void ProcessSlot(Daemon* daemon, Client* client)
+{
+    const DaemonConfig* config = &daemon->config;
+    uint32_t index = (uint32_t)(client->processed % config->slotCount);
+    DaemonSlot* slot = &client->ring->slots[index];
+    // Read once, the client could change them while the chunk is computed.
+    uint32_t flags = slot->flags;
+    uint32_t count = slot->count;
+
+    ComputeStats setup = {0};
+    if ((flags & DAEMON_SLOT_FIRST) != 0)
+    {
+        ReleaseStream(daemon, client);
+        ComputeOptions options = slot->options;
+        if (NormalizeOptions(config, &options))
+        {
+            client->stream = AcquireStream(daemon, &options, &setup);
+            client->streamOptions = options;
+        }
+    }
+
+    ComputeStats stats = {0};
+    int status = 1;
+    if (client->stream != NULL && count > 0 && count <= config->chunkCapacity)
+    {
+        status = PushComputeStream(client->stream, DaemonSlotCandles(client->ring, config->chunkCapacity, config->slotCount, index), count,
+                                   DaemonSlotIndicators(client->ring, config->chunkCapacity, config->slotCount, index), &stats);
+    }
+    // The setup is reported with the first chunk computed on a new stream.
+    stats.setupMs = setup.setupMs;
+    stats.instanceMs = setup.instanceMs;
+    stats.deviceMs = setup.deviceMs;
+    stats.allocationMs = setup.allocationMs;
+    stats.pipelineMs = setup.pipelineMs;
+    stats.autotuneMs = setup.autotuneMs;
+    // Without this chunk the halo of the next one would be wrong, the series ends here.
+    if (status != 0)
+        ReleaseStream(daemon, client);
+
+    slot->stats = stats;
+    slot->status = status;
+    atomic_store_explicit(&client->ring->completed, ++client->processed, memory_order_release);
+    uint64_t event = 1;
+    if (write(client->responseEvent, &event, sizeof(event)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "could not signal a client: %s\n", strerror(errno));
+}
+
+static int Listen(Daemon* daemon)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", daemon->config.socketPath);
+    daemon->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (daemon->listener < 0)
+        return 1;
+    // A socket nobody answers on is left over from a daemon that did not exit cleanly.
+    if (connect(daemon->listener, (struct sockaddr*)&address, sizeof(address)) == 0)
+    {
+        fprintf(stderr, "a daemon is already listening on %s\n", address.sun_path);
+        return 1;
+    }
+    unlink(address.sun_path);
+    if (bind(daemon->listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(daemon->listener, 16) != 0)
+    {
+        fprintf(stderr, "could not listen on %s: %s\n", address.sun_path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Daemon daemon = { .listener = -1 };
+    if (ParseArguments(argc, argv, &daemon.config) != 0)
+    {
+        fprintf(stderr, "usage: %s [--socket path] [--chunk-candles n] [--slots n] [--idle-streams n] [--max-clients n]\n", argv[0]);
+        return 2;
+    }
+    daemon.clients = (Client*)calloc(daemon.config.maxClients, sizeof(Client));
+    daemon.idle = (PooledStream*)calloc(daemon.config.idleStreams + 1, sizeof(PooledStream));
+    struct pollfd* fds = (struct pollfd*)calloc(1 + 2 * (size_t)daemon.config.maxClients, sizeof(struct pollfd));
+    if (daemon.clients == NULL || daemon.idle == NULL || fds == NULL || Listen(&daemon) != 0)
+        return 1;
+
+    // No SA_RESTART, the signal interrupts poll.
+    struct sigaction action = { .sa_handler = OnSignal };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    fprintf(stderr, "listening on %s\n", daemon.config.socketPath);
+
+    bool pending = false;
+    while (!stopping)
+    {
+        fds[0] = (struct pollfd){ .fd = daemon.listener, .events = POLLIN };
+        for (uint32_t c = 0; c < daemon.clientCount; ++c)
+        {
+            fds[1 + 2 * c] = (struct pollfd){ .fd = daemon.clients[c].socket, .events = POLLIN };
+            fds[2 + 2 * c] = (struct pollfd){ .fd = daemon.clients[c].requestEvent, .events = POLLIN };
+        }
+        // Sleeps only when every submitted chunk is computed.
+        uint32_t polledClients = daemon.clientCount;
+        if (poll(fds, 1 + 2 * polledClients, pending ? 0 : -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (uint32_t c = polledClients; c-- > 0; )
+        {
+            // The client never writes to the socket, readable means it hung up.
+            uint64_t events;
+            if (fds[1 + 2 * c].revents != 0)
+                DropClient(&daemon, c);
+            else if (fds[2 + 2 * c].revents != 0 && read(daemon.clients[c].requestEvent, &events, sizeof(events)) < 0 && errno != EAGAIN)
+                DropClient(&daemon, c);
+        }
+        if (fds[0].revents != 0)
+            AcceptClient(&daemon);
+
+        // One chunk per connection and round, a long series does not hold the others up.
+        pending = false;
+        for (uint32_t c = daemon.clientCount; c-- > 0; )
+        {
+            int64_t slots = PendingSlots(&daemon, &daemon.clients[c]);
+            if (slots < 0)
+            {
+                fprintf(stderr, "dropping a client that broke the ring protocol\n");
+                DropClient(&daemon, c);
+                continue;
+            }
+            if (slots == 0)
+                continue;
+            ProcessSlot(&daemon, &daemon.clients[c]);
+            pending |= slots > 1;
+        }
+    }
+
+    while (daemon.clientCount > 0)
+        DropClient(&daemon, daemon.clientCount - 1);
+    for (uint32_t i = 0; i < daemon.idleCount; ++i)
+        CloseComputeStream(daemon.idle[i].stream);
+    close(daemon.listener);
+    unlink(daemon.config.socketPath);
+    free(fds);
+    free(daemon.idle);
+    free(daemon.clients);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "computesample.h"
+
+// Wire format shared by computesample-daemon and ComputeResultDaemon.
+//
+// On accept the daemon sends a DaemonHello with three descriptors attached
+// (SCM_RIGHTS): a sealed memfd holding the ring of the connection, an eventfd the
+// client writes after submitting slots and one the daemon writes after completing
+// them. The socket carries nothing else, it only tells each side when the other
+// one is gone.
+//
+// The memfd starts with a DaemonRing followed by the candles, then the indicators,
+// of every slot, each one chunkCapacity elements long. The client fills the candles
+// and the descriptor of slot submitted % slotCount and publishes it by incrementing
+// submitted; the daemon computes the slot in place, sets its status and stats and
+// increments completed. Both counters only grow, release stores pair with acquire
+// loads on the other side.
+
+#define DAEMON_MAGIC 0x444d5343u // "CSMD"
+#define DAEMON_VERSION 1u
+#define DAEMON_SOCKET_NAME "computesample.sock"
+
+// The slot starts a new series computed with its options, the other slots continue
+// the series of the slot before them.
+#define DAEMON_SLOT_FIRST 1u
+
+typedef struct DaemonHello
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkCapacity;
+    uint32_t slotCount;
+    uint64_t size; // Of the memfd
+} DaemonHello;
+
+typedef struct DaemonSlot
+{
+    // Written by the client
+    ComputeOptions options; // Only read with DAEMON_SLOT_FIRST
+    uint32_t flags;
+    uint32_t count;
+    // Written by the daemon
+    int32_t status;
+    uint32_t reserved;
+    ComputeStats stats;
+} DaemonSlot;
+
+typedef struct DaemonRing
+{
+    _Alignas(64) _Atomic uint64_t submitted;
+    _Alignas(64) _Atomic uint64_t completed;
+    _Alignas(64) DaemonSlot slots[];
+} DaemonRing;
+
+static inline size_t DaemonRingSize(uint32_t chunkCapacity, uint32_t slotCount)
+{
+    return sizeof(DaemonRing) + slotCount * (sizeof(DaemonSlot) + (size_t)chunkCapacity * (sizeof(Candlestick) + sizeof(Indicator)));
+}
+
+static inline Candlestick* DaemonSlotCandles(DaemonRing* ring, uint32_t chunkCapacity, uint32_t slotCount, uint32_t slot)
+{
+    char* candles = (char*)&ring->slots[slotCount];
+    return (Candlestick*)candles + (size_t)slot * chunkCapacity;
+}
+
+static inline Indicator* DaemonSlotIndicators(DaemonRing* ring, uint32_t chunkCapacity, uint32_t slotCount, uint32_t slot)
+{
+    Indicator* indicators = (Indicator*)(DaemonSlotCandles(ring, chunkCapacity, slotCount, slotCount));
+    return indicators + (size_t)slot * chunkCapacity;
+}
+
+// $XDG_RUNTIME_DIR/computesample.sock, or /tmp/computesample.sock without a runtime directory.
+static inline void DaemonDefaultSocketPath(char* path, size_t length)
+{
+    const char* directory = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, length, "%s/%s", directory != NULL && directory[0] != '\0' ? directory : "/tmp", DAEMON_SOCKET_NAME);
+}
+
+#endif
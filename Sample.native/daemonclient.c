@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+// Client side of computesample-daemon, see daemon.h for the protocol.
+
+struct ComputeDaemon
+{
+    int socket;
+    int requestEvent;
+    int responseEvent;
+    DaemonRing* ring;
+    size_t size;
+    uint32_t chunkCapacity;
+    uint32_t slotCount;
+    uint64_t submitted;
+    uint64_t harvested; // Completed slots whose results were read back
+    bool seriesOpen; // ContinueResultDaemon has a series to extend
+    bool broken; // The daemon is gone or broke the protocol
+};
+
+// Receives the hello and the memfd, request and response eventfds attached to it.
+static int ReceiveHello(int socketFd, DaemonHello* hello, int fds[3])
+{
+    union
+    {
+        char buffer[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = hello, .iov_len = sizeof(*hello) };
+    struct msghdr message = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer) };
+    ssize_t received;
+    do
+        received = recvmsg(socketFd, &message, MSG_CMSG_CLOEXEC);
+    while (received < 0 && errno == EINTR);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+        return 1;
+    size_t fdCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int receivedFds[3] = { -1, -1, -1 };
+    memcpy(receivedFds, CMSG_DATA(header), (fdCount < 3 ? fdCount : 3) * sizeof(int));
+    if (received != (ssize_t)sizeof(*hello) || fdCount != 3 || (message.msg_flags & MSG_CTRUNC) != 0)
+    {
+        for (size_t i = 0; i < 3; ++i)
+        {
+            if (receivedFds[i] >= 0)
+                close(receivedFds[i]);
+        }
+        return 1;
+    }
+    memcpy(fds, receivedFds, sizeof(receivedFds));
+    return 0;
+}
+
+int ConnectComputeDaemon(const char* socket_path, ComputeDaemon** daemon)
+{
+    if (daemon == NULL)
+        return 1;
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (socket_path != NULL)
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    else
+        DaemonDefaultSocketPath(address.sun_path, sizeof(address.sun_path));
+
+    int socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socketFd < 0)
+        return 1;
+    DaemonHello hello;
+    int fds[3];
+    if (connect(socketFd, (struct sockaddr*)&address, sizeof(address)) != 0 || ReceiveHello(socketFd, &hello, fds) != 0)
+    {
+        close(socketFd);
+        return 1;
+    }
+    ComputeDaemon* connected = (ComputeDaemon*)calloc(1, sizeof(ComputeDaemon));
+    void* ring = MAP_FAILED;
+    if (connected != NULL && hello.magic == DAEMON_MAGIC && hello.version == DAEMON_VERSION &&
+        hello.chunkCapacity > 0 && hello.slotCount > 0 && hello.size == DaemonRingSize(hello.chunkCapacity, hello.slotCount))
+        ring = mmap(NULL, hello.size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]); // The mapping keeps the memfd alive
+    if (ring == MAP_FAILED)
+    {
+        close(fds[1]);
+        close(fds[2]);
+        close(socketFd);
+        free(connected);
+        return 1;
+    }
+    *connected = (struct ComputeDaemon){
+        .socket = socketFd,
+        .requestEvent = fds[1],
+        .responseEvent = fds[2],
+        .ring = (DaemonRing*)ring,
+        .size = hello.size,
+        .chunkCapacity = hello.chunkCapacity,
+        .slotCount = hello.slotCount
+    };
+    *daemon = connected;
+    return 0;
+}
+
+void DisconnectComputeDaemon(ComputeDaemon* daemon)
+{
+    if (daemon == NULL)
+        return;
+    munmap(daemon->ring, daemon->size);
+    close(daemon->requestEvent);
+    close(daemon->responseEvent);
+    close(daemon->socket);
+    free(daemon);
+}
+
+int CheckComputeDaemon(ComputeDaemon* daemon)
+{
+    if (daemon == NULL || daemon->broken)
+        return 1;
+    // The daemon never writes to the socket, it only becomes readable or hung up once
+    // the daemon closed its end.
+    struct pollfd fd = { .fd = daemon->socket, .events = POLLIN };
+    int ready;
+    do
+        ready = poll(&fd, 1, 0);
+    while (ready < 0 && errno == EINTR);
+    if (ready != 0)
+        daemon->broken = true;
+    return daemon->broken ? 1 : 0;
+}
+
+// Blocks until the daemon completed slot daemon->harvested. The socket only becomes
+// readable when the daemon closes it.
+static int WaitForSlot(ComputeDaemon* daemon)
+{
+    while (atomic_load_explicit(&daemon->ring->completed, memory_order_acquire) <= daemon->harvested)
+    {
+        struct pollfd fds[2] = {
+            { .fd = daemon->responseEvent, .events = POLLIN },
+            { .fd = daemon->socket, .events = POLLIN }
+        };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return 1;
+        if (fds[1].revents != 0)
+            return 1;
+        uint64_t events;
+        if (fds[0].revents != 0 && read(daemon->responseEvent, &events, sizeof(events)) < 0 && errno != EAGAIN && errno != EINTR)
+            return 1;
+    }
+    return 0;
+}
+
+// Stage timings add up over the chunks of a call, the setup only comes with the
+// chunk that opened a device.
+static void AddChunkStats(ComputeStats* total, const ComputeStats* chunk)
+{
+    total->setupMs += chunk->setupMs;
+    total->uploadMs += chunk->uploadMs;
+    total->computeMs += chunk->computeMs;
+    total->readbackMs += chunk->readbackMs;
+    total->instanceMs += chunk->instanceMs;
+    total->deviceMs += chunk->deviceMs;
+    total->allocationMs += chunk->allocationMs;
+    total->pipelineMs += chunk->pipelineMs;
+    total->autotuneMs += chunk->autotuneMs;
+    total->uploadCopyMs += chunk->uploadCopyMs;
+    total->readbackCopyMs += chunk->readbackCopyMs;
+    total->gpuUploadMs += chunk->gpuUploadMs;
+    total->gpuSmaPass1Ms += chunk->gpuSmaPass1Ms;
+    total->gpuSmaPass2Ms += chunk->gpuSmaPass2Ms;
+    total->gpuReadbackMs += chunk->gpuReadbackMs;
+    total->gpuTimestampsValid = chunk->gpuTimestampsValid;
+    total->storagePrecision = chunk->storagePrecision;
+    total->kernelVariant = chunk->kernelVariant;
+    total->workgroupSize = chunk->workgroupSize;
+}
+
+// Reads back the oldest slot in flight, the chunk at offset of the current call.
+static int HarvestSlot(ComputeDaemon* daemon, Indicator* output, size_t offset, ComputeStats* stats)
+{
+    if (WaitForSlot(daemon) != 0)
+    {
+        daemon->broken = true;
+        return 1;
+    }
+    uint32_t index = (uint32_t)(daemon->harvested++ % daemon->slotCount);
+    const DaemonSlot* slot = &daemon->ring->slots[index];
+    if (slot->status != 0)
+        return 1;
+    memcpy(output + offset, DaemonSlotIndicators(daemon->ring, daemon->chunkCapacity, daemon->slotCount, index), slot->count * sizeof(Indicator));
+    AddChunkStats(stats, &slot->stats);
+    return 0;
+}
+
+// Copies each chunk into the next free slot as soon as there is one, so that the
+// daemon computes a chunk while the following one is written.
+static int ComputeThroughDaemon(ComputeDaemon* daemon, const Candlestick* kline, size_t kline_elements_count, Indicator* output,
+                                const ComputeOptions* options, ComputeStats* stats)
+{
+    ComputeStats timings = {0};
+    int status = 0;
+    size_t harvestedOffset = 0;
+    for (size_t offset = 0; offset < kline_elements_count && !daemon->broken; )
+    {
+        if (daemon->submitted - daemon->harvested == daemon->slotCount)
+        {
+            size_t count = daemon->ring->slots[daemon->harvested % daemon->slotCount].count;
+            status |= HarvestSlot(daemon, output, harvestedOffset, &timings);
+            harvestedOffset += count;
+            continue;
+        }
+        uint32_t index = (uint32_t)(daemon->submitted % daemon->slotCount);
+        uint32_t count = (uint32_t)(kline_elements_count - offset < daemon->chunkCapacity ? kline_elements_count - offset : daemon->chunkCapacity);
+        DaemonSlot* slot = &daemon->ring->slots[index];
+        memcpy(DaemonSlotCandles(daemon->ring, daemon->chunkCapacity, daemon->slotCount, index), kline + offset, count * sizeof(Candlestick));
+        slot->flags = 0;
+        if (offset == 0 && options != NULL)
+        {
+            slot->options = *options;
+            slot->flags = DAEMON_SLOT_FIRST;
+        }
+        slot->count = count;
+        atomic_store_explicit(&daemon->ring->submitted, ++daemon->submitted, memory_order_release);
+        uint64_t event = 1;
+        if (write(daemon->requestEvent, &event, sizeof(event)) < 0 && errno != EAGAIN)
+            daemon->broken = true;
+        offset += count;
+    }
+    while (daemon->harvested < daemon->submitted && !daemon->broken)
+    {
+        size_t count = daemon->ring->slots[daemon->harvested % daemon->slotCount].count;
+        status |= HarvestSlot(daemon, output, harvestedOffset, &timings);
+        harvestedOffset += count;
+    }
+    // A failed chunk leaves the series without the candles it needs, it cannot be continued.
+    daemon->seriesOpen = status == 0 && !daemon->broken;
+    if (stats != NULL)
+        *stats = timings;
+    return status != 0 || daemon->broken ? 1 : 0;
+}
+
+int ComputeResultDaemon(ComputeDaemon* daemon, const Candlestick* kline, size_t kline_elements_count, Indicator* output,
+                        const ComputeOptions* options, ComputeStats* stats)
+{
+    if (daemon == NULL || daemon->broken || kline == NULL || output == NULL || kline_elements_count == 0)
+        return 1;
+    ComputeOptions defaults = {0};
+    return ComputeThroughDaemon(daemon, kline, kline_elements_count, output, options != NULL ? options : &defaults, stats);
+}
+
+int ContinueResultDaemon(ComputeDaemon* daemon, const Candlestick* kline, size_t kline_elements_count, Indicator* output, ComputeStats* stats)
+{
+    if (daemon == NULL || daemon->broken || !daemon->seriesOpen || kline == NULL || output == NULL || kline_elements_count == 0)
+        return 1;
+    return ComputeThroughDaemon(daemon, kline, kline_elements_count, output, NULL, stats);
+}
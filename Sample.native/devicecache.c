@@ -0,0 +1,180 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "devicecache.h"
+
+#define DEVICE_CACHE_PATH_LENGTH 4096
+#define TUNING_MAX_ENTRIES 64
+#define TUNING_KEY_LENGTH 64
+
+typedef struct TuningEntry
+{
+    char key[TUNING_KEY_LENGTH];
+    uint32_t workgroupSize;
+} TuningEntry;
+
+// Resolves the cache directory and creates it along with any missing parents.
+static bool CacheDirectory(char* path, size_t length)
+{
+    const char* directory;
+    int written;
+    if ((directory = getenv("COMPUTESAMPLE_CACHE_DIR")) != NULL && *directory != '\0')
+        written = snprintf(path, length, "%s", directory);
+    else if ((directory = getenv("XDG_CACHE_HOME")) != NULL && *directory != '\0')
+        written = snprintf(path, length, "%s/computesample", directory);
+    else if ((directory = getenv("HOME")) != NULL && *directory != '\0')
+        written = snprintf(path, length, "%s/.cache/computesample", directory);
+    else
+        return false;
+    if (written < 0 || (size_t)written >= length)
+        return false;
+
+    for (char* separator = path + 1; *separator != '\0'; ++separator)
+    {
+        if (*separator != '/')
+            continue;
+        *separator = '\0';
+        mkdir(path, 0755);
+        *separator = '/';
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static bool CacheFilePath(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const char* extension, char* path, size_t length)
+{
+    char directory[DEVICE_CACHE_PATH_LENGTH];
+    if (!CacheDirectory(directory, sizeof(directory)))
+        return false;
+    char name[DEVICE_CACHE_UUID_SIZE * 2 + 1];
+    for (int i = 0; i < DEVICE_CACHE_UUID_SIZE; ++i)
+        snprintf(name + i * 2, 3, "%02x", uuid[i]);
+    int written = snprintf(path, length, "%s/%s.%s", directory, name, extension);
+    return written >= 0 && (size_t)written < length;
+}
+
+static void* ReadWholeFile(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    char* data = NULL;
+    long length = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (length = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        data = (char*)malloc((size_t)length + 1);
+        if (data != NULL && fread(data, 1, (size_t)length, fp) != (size_t)length)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+    if (data == NULL)
+        return NULL;
+    data[length] = '\0'; // Lets the text files be parsed in place
+    *size = (size_t)length;
+    return data;
+}
+
+// Several processes and threads can share the cache, so files are written to a
+// temporary file of their own and replaced with a rename, a reader never sees a
+// partially written one.
+static void WriteFileAtomically(const char* path, const void* data, size_t size)
+{
+    char temporary[DEVICE_CACHE_PATH_LENGTH + 32];
+    snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+    int fd = mkostemp(temporary, O_CLOEXEC);
+    if (fd < 0)
+        return;
+    FILE* fp = fchmod(fd, 0644) == 0 ? fdopen(fd, "wb") : NULL;
+    if (fp == NULL)
+    {
+        close(fd);
+        unlink(temporary);
+        return;
+    }
+    bool written = fwrite(data, 1, size, fp) == size;
+    if (fclose(fp) != 0 || !written || rename(temporary, path) != 0)
+        unlink(temporary);
+}
+
+void* LoadPipelineCacheData(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], size_t* size)
+{
+    char path[DEVICE_CACHE_PATH_LENGTH];
+    *size = 0;
+    if (!CacheFilePath(uuid, "pipelinecache", path, sizeof(path)))
+        return NULL;
+    return ReadWholeFile(path, size);
+}
+
+void StorePipelineCacheData(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const void* data, size_t size)
+{
+    char path[DEVICE_CACHE_PATH_LENGTH];
+    if (data != NULL && size > 0 && CacheFilePath(uuid, "pipelinecache", path, sizeof(path)))
+        WriteFileAtomically(path, data, size);
+}
+
+// The tuning file holds one "<key> <workgroup size>" line per kernel configuration.
+static uint32_t LoadTuningEntries(const char* path, TuningEntry* entries, uint32_t capacity)
+{
+    size_t size = 0;
+    char* text = (char*)ReadWholeFile(path, &size);
+    if (text == NULL)
+        return 0;
+    uint32_t count = 0;
+    for (char* line = strtok(text, "\n"); line != NULL && count < capacity; line = strtok(NULL, "\n"))
+    {
+        TuningEntry* entry = &entries[count];
+        if (sscanf(line, "%63s %u", entry->key, &entry->workgroupSize) == 2 && entry->workgroupSize > 0)
+            ++count;
+    }
+    free(text);
+    return count;
+}
+
+uint32_t LoadTunedWorkgroupSize(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const char* key)
+{
+    char path[DEVICE_CACHE_PATH_LENGTH];
+    if (!CacheFilePath(uuid, "tuning", path, sizeof(path)))
+        return 0;
+    TuningEntry entries[TUNING_MAX_ENTRIES];
+    uint32_t count = LoadTuningEntries(path, entries, TUNING_MAX_ENTRIES);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+            return entries[i].workgroupSize;
+    }
+    return 0;
+}
+
+void StoreTunedWorkgroupSize(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const char* key, uint32_t workgroupSize)
+{
+    char path[DEVICE_CACHE_PATH_LENGTH];
+    if (strlen(key) >= TUNING_KEY_LENGTH || !CacheFilePath(uuid, "tuning", path, sizeof(path)))
+        return;
+    TuningEntry entries[TUNING_MAX_ENTRIES];
+    uint32_t count = LoadTuningEntries(path, entries, TUNING_MAX_ENTRIES);
+    uint32_t i = 0;
+    while (i < count && strcmp(entries[i].key, key) != 0)
+        ++i;
+    if (i == TUNING_MAX_ENTRIES)
+        return;
+    if (i == count)
+        ++count;
+    snprintf(entries[i].key, sizeof(entries[i].key), "%s", key);
+    entries[i].workgroupSize = workgroupSize;
+
+    char text[TUNING_MAX_ENTRIES * (TUNING_KEY_LENGTH + 16)];
+    size_t length = 0;
+    for (uint32_t e = 0; e < count; ++e)
+        length += (size_t)snprintf(text + length, sizeof(text) - length, "%s %u\n", entries[e].key, entries[e].workgroupSize);
+    WriteFileAtomically(path, text, length);
+}
@@ -0,0 +1,22 @@
+#ifndef DEVICECACHE_H
+#define DEVICECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEVICE_CACHE_UUID_SIZE 16
+
+// Per device files kept in $COMPUTESAMPLE_CACHE_DIR, $XDG_CACHE_HOME/computesample
+// or ~/.cache/computesample. Files are named after the pipelineCacheUUID, so a
+// driver update starts from an empty pipeline cache and retunes.
+
+// Returns a malloc'ed copy of the stored VkPipelineCache data, or NULL when there is none.
+void* LoadPipelineCacheData(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], size_t* size);
+void StorePipelineCacheData(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const void* data, size_t size);
+
+// Autotuned workgroup sizes, one per kernel configuration key. Returns 0 when the
+// key has not been tuned on this device yet.
+uint32_t LoadTunedWorkgroupSize(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const char* key);
+void StoreTunedWorkgroupSize(const uint8_t uuid[DEVICE_CACHE_UUID_SIZE], const char* key, uint32_t workgroupSize);
+
+#endif
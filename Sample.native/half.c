@@ -0,0 +1,174 @@
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HALF_HAS_F16C 1
+#endif
+#include "half.h"
+
+static uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff)
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // Inf or NaN
+    int32_t halfExponent = (int32_t)exponent - 127 + 15;
+    if (halfExponent >= 0x1f)
+        return (uint16_t)(sign | 0x7c00); // Overflows to Inf
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10)
+            return (uint16_t)sign; // Underflows to zero
+        // Subnormal half, shift the mantissa including its implicit bit into place.
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    // Round to nearest even, a carry out of the mantissa correctly bumps the exponent.
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return (uint16_t)(sign | half);
+}
+
+static float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0x1f)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent == 0)
+    {
+        float value = (float)mantissa * 5.9604644775390625e-8f; // mantissa * 2^-24
+        return sign ? -value : value;
+    }
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#ifdef HALF_HAS_F16C
+static bool HasF16c(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+    }
+    return supported;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t ConvertCandlesToHalfF16c(const Candlestick* candles, uint16_t* halves, size_t count)
+{
+    // Each 256 bit register holds two Candlesticks, narrowed into one 128 bit store.
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256 first = _mm256_loadu_ps((const float*)&candles[i]);
+        __m256 second = _mm256_loadu_ps((const float*)&candles[i + 2]);
+        _mm_storeu_si128((__m128i*)&halves[i * 4], _mm256_cvtps_ph(first, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storeu_si128((__m128i*)&halves[i * 4 + 8], _mm256_cvtps_ph(second, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t ConvertHalfToIndicatorsF16c(const uint16_t* halves, Indicator* indicators, size_t count)
+{
+    size_t i = 0;
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sma = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&halves[i]));
+        __m128 quarters[2] = { _mm256_castps256_ps128(sma), _mm256_extractf128_ps(sma, 1) };
+        for (int q = 0; q < 2; ++q)
+        {
+            // Spread four results into four Indicators with zeroed padding.
+            __m128 lo = _mm_unpacklo_ps(quarters[q], zero);
+            __m128 hi = _mm_unpackhi_ps(quarters[q], zero);
+            Indicator* dst = &indicators[i + q * 4];
+            _mm_storeu_ps((float*)&dst[0], _mm_movelh_ps(lo, zero));
+            _mm_storeu_ps((float*)&dst[1], _mm_movehl_ps(zero, lo));
+            _mm_storeu_ps((float*)&dst[2], _mm_movelh_ps(hi, zero));
+            _mm_storeu_ps((float*)&dst[3], _mm_movehl_ps(zero, hi));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t ConvertHalfToCandlesF16c(const uint16_t* halves, Candlestick* candles, size_t count)
+{
+    // The inverse of ConvertCandlesToHalfF16c, two Candlesticks per 128 bit load.
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm256_storeu_ps((float*)&candles[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&halves[i * 4])));
+    return i;
+}
+#endif
+
+void ConvertCandlesToHalf(const Candlestick* candles, uint16_t* halves, size_t count)
+{
+    size_t i = 0;
+#ifdef HALF_HAS_F16C
+    if (HasF16c())
+        i = ConvertCandlesToHalfF16c(candles, halves, count);
+#endif
+    for (; i < count; ++i)
+    {
+        halves[i * 4 + 0] = FloatToHalf(candles[i].open);
+        halves[i * 4 + 1] = FloatToHalf(candles[i].high);
+        halves[i * 4 + 2] = FloatToHalf(candles[i].low);
+        halves[i * 4 + 3] = FloatToHalf(candles[i].close);
+    }
+}
+
+void ConvertHalfToIndicators(const uint16_t* halves, Indicator* indicators, size_t count)
+{
+    size_t i = 0;
+#ifdef HALF_HAS_F16C
+    if (HasF16c())
+        i = ConvertHalfToIndicatorsF16c(halves, indicators, count);
+#endif
+    for (; i < count; ++i)
+        indicators[i] = (Indicator){ .sma = HalfToFloat(halves[i]) };
+}
+
+void ConvertHalfToCandles(const uint16_t* halves, Candlestick* candles, size_t count)
+{
+    size_t i = 0;
+#ifdef HALF_HAS_F16C
+    if (HasF16c())
+        i = ConvertHalfToCandlesF16c(halves, candles, count);
+#endif
+    for (; i < count; ++i)
+    {
+        candles[i] = (Candlestick){
+            .open = HalfToFloat(halves[i * 4 + 0]),
+            .high = HalfToFloat(halves[i * 4 + 1]),
+            .low = HalfToFloat(halves[i * 4 + 2]),
+            .close = HalfToFloat(halves[i * 4 + 3])
+        };
+    }
+}
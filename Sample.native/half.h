@@ -0,0 +1,13 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include "computesample.h"
+
+// Conversions between the host 32 bit layouts and the packed 16 bit storage
+// layouts used by the COMPUTE_PRECISION_FP16 shaders. Uses F16C when the CPU
+// supports it, otherwise a portable round-to-nearest-even conversion.
+void ConvertCandlesToHalf(const Candlestick* candles, uint16_t* halves, size_t count);
+void ConvertHalfToIndicators(const uint16_t* halves, Indicator* indicators, size_t count);
+void ConvertHalfToCandles(const uint16_t* halves, Candlestick* candles, size_t count);
+
+#endif
@@ -7,10 +7,62 @@
 #include <math.h>
 #include <assert.h>
 #include <string.h>
+#include "computesample.h"
+#include "devicecache.h"
+#include "half.h"
 #include "smaPass1.h"
 #include "smaPass2.h"
-
-const int WORKGROUP_SIZE = 256;
+#include "smaPass1Fp16.h"
+#include "smaPass2Fp16.h"
+#include "smaPass1Shared.h"
+#include "smaPass1SharedFp16.h"
+#include "smaPass1Subgroup.h"
+#include "smaPass1SubgroupFp16.h"
+#include "resample.h"
+#include "resampleFp16.h"
+#include "rank.h"
+#include "rankFp16.h"
+#include "correlation.h"
+#include "correlationPairs.h"
+
+#define DEFAULT_WORKGROUP_SIZE 256
+// Shorter jobs are too quick to time reliably, they keep the default size until a larger job tunes the device.
+#define AUTOTUNE_MIN_ELEMENTS (1u << 18)
+#define AUTOTUNE_DISPATCHES 8
+// Cross-sectional rows start on this many elements so that every row load is aligned alike.
+#define ROW_ALIGNMENT_ELEMENTS 32
+// Local size of rank_shader.comp along time and along symbols.
+#define RANK_TILE_TIMES 32
+#define RANK_TILE_ROWS 4
+// Pairs per workgroup along each axis of correlation_shader.comp.
+#define CORRELATION_TILE 16
+// Bytes ahead of the pairs in the device buffer of a pairs job, the pair count padded to the pair alignment.
+#define CORRELATION_PAIRS_HEADER 16
+
+static const uint32_t AutotuneCandidates[] = { 64, 128, 256, 512, 1024 };
+static const char* KernelVariantNames[] = { "auto", "naive", "shared", "subgroup" };
+static const char* PrecisionNames[] = { "fp32", "fp16" };
+
+// Timestamp query slots, a begin/end pair around each recorded stage.
+enum TimestampQuery
+{
+    TIMESTAMP_UPLOAD_BEGIN,
+    TIMESTAMP_UPLOAD_END,
+    TIMESTAMP_SMA_PASS1_BEGIN,
+    TIMESTAMP_SMA_PASS1_END,
+    TIMESTAMP_SMA_PASS2_BEGIN,
+    TIMESTAMP_SMA_PASS2_END,
+    TIMESTAMP_READBACK_BEGIN,
+    TIMESTAMP_READBACK_END,
+    // Optional stages, left unwritten by the jobs that do not run them.
+    TIMESTAMP_RESAMPLE_BEGIN,
+    TIMESTAMP_RESAMPLE_END,
+    TIMESTAMP_RANK_BEGIN,
+    TIMESTAMP_RANK_END,
+    TIMESTAMP_CORRELATION_BEGIN,
+    TIMESTAMP_CORRELATION_END,
+    TIMESTAMP_COUNT
+};
 
 #define VK_CHECK_RESULT(f)                                                                \
     {                                                                                     \
@@ -22,21 +74,18 @@ const int WORKGROUP_SIZE = 256;
         }                                                                                 \
     }
 
-typedef struct Candlestick
-{
-    float open;
-    float high;
-    float low;
-    float close;
-} Candlestick;
-
-typedef struct Indicator
+// Push constants of correlation_shader.comp, starting with the Shape of the other shaders.
+typedef struct CorrelationShape
 {
-    float sma;
-    float padding1; // Can be used for future Indicators inclusion like DI+/DI-/ADX and so forth
-    float padding2;
-    float padding3;
-} Indicator;
+    uint32_t timeCount;
+    uint32_t rowStride;
+    uint32_t rowCount;
+    uint32_t step;
+    uint32_t matrixCount;
+    uint32_t pairCapacity;
+    float threshold;
+    uint32_t covariance;
+} CorrelationShape;
 
 typedef struct ComputeApplication
 {
@@ -59,11 +108,66 @@ typedef struct ComputeApplication
     VkDescriptorSetLayout descriptorSetLayout;
     VkQueue queue;
     uint32_t queueFamilyIndex;
+    uint32_t deviceIndex;
+    uint32_t storagePrecision;
+    uint32_t kernelVariant;
+    uint32_t period;
+    uint32_t workgroupSize;
+    bool autotunePending;
+
+    // Timeframe resampling, timeframeCount is 0 for plain SMA jobs. Offsets count
+    // elements of the device input and output buffers, see LayoutTimeframes.
+    uint32_t timeframeCount;
+    uint32_t timeframes[COMPUTE_MAX_TIMEFRAMES];
+    uint32_t timeframeElementsCount[COMPUTE_MAX_TIMEFRAMES];
+    uint32_t timeframeInputOffset[COMPUTE_MAX_TIMEFRAMES];
+    uint32_t timeframeOutputOffset[COMPUTE_MAX_TIMEFRAMES];
+    VkDescriptorSet resampleDescriptorSets[COMPUTE_MAX_TIMEFRAMES];
+    VkDescriptorSet timeframeDescriptorSets[COMPUTE_MAX_TIMEFRAMES];
+    VkShaderModule resampleShaderModule;
+    VkPipeline resamplePipelines[COMPUTE_MAX_TIMEFRAMES];
+    // Timeframe and correlation jobs record everything into this single command buffer.
+    VkCommandBuffer jobCommandBuffer;
+
+    // Series layout pushed to the SMA shaders: symbolCount rows of timeCount elements
+    // starting rowStride elements apart. A plain job is a single row.
+    uint32_t symbolCount;
+    uint32_t timeCount;
+    uint32_t rowStride;
+    // Cross-sectional percentiles, only computed when rank is set.
+    bool rank;
+    VkShaderModule rankShaderModule;
+    VkPipeline rankPipeline;
+    VkDescriptorSet rankDescriptorSet;
+    uint32_t percentileBufferSize;
+    // Rolling correlation, replaces the SMA passes when set. The input buffer then
+    // holds the returns of every row and the output buffer either the matrices or,
+    // for a pairs job, the pair count followed by pairCapacity pairs.
+    bool correlation;
+    bool correlationPairs;
+    CorrelationOptions correlationOptions;
+    uint32_t correlationMatrixCount;
+    uint32_t pairCapacity;
+    VkShaderModule correlationShaderModule;
+    VkPipeline correlationPipeline;
+    // Set by streams, which submit the same SMA command buffers for every chunk.
+    bool reusable;
+
+    // Persisted in the device cache directory, see devicecache.h
+    VkPipelineCache pipelineCache;
+    size_t pipelineCacheLoadedSize;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+
+    // Optional GPU timestamps, queryPool is VK_NULL_HANDLE when disabled or unsupported
+    VkQueryPool queryPool;
+    uint64_t timestampMask;
+    float timestampPeriod;
 
     // Sample data
     uint32_t* inputData;
     uint32_t inputDataElementsCount;
     uint32_t inputBufferSize;
+    uint32_t outputBufferSize;
 
     // Related to Input Buffer
     VkBuffer inputBuffer;
@@ -78,6 +182,12 @@ typedef struct ComputeApplication
 
     VkBuffer deviceOnlyOutputBuffer;
     VkDeviceMemory deviceOnlyOutputBufferMemory;
+
+    VkBuffer percentileBuffer;
+    VkDeviceMemory percentileBufferMemory;
+
+    VkBuffer deviceOnlyPercentileBuffer;
+    VkDeviceMemory deviceOnlyPercentileBufferMemory;
 } *ComputeApplication;
 
 static void InitializeVulkanInstance(ComputeApplication this)
@@ -112,9 +222,15 @@ static void SelectPhysicalDevice(ComputeApplication this)
         return;
     }
 
+    if (this->deviceIndex >= deviceCount)
+    {
+        printf("device index %u is out of range, %u devices available\n", this->deviceIndex, deviceCount);
+        return;
+    }
+
     VkPhysicalDevice devices[deviceCount];
     VK_CHECK_RESULT(vkEnumeratePhysicalDevices(this->instance, &deviceCount, devices));
-    this->physicalDevice = devices[0];
+    this->physicalDevice = devices[this->deviceIndex];
 }
 
 static uint32_t getComputeQueueFamilyIndex(ComputeApplication this)
@@ -146,6 +262,246 @@ static uint32_t getComputeQueueFamilyIndex(ComputeApplication this)
     return i;
 }
 
+static bool Supports16BitStorage(ComputeApplication this)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1)
+        return false;
+
+    VkPhysicalDevice16BitStorageFeatures storageFeatures = (VkPhysicalDevice16BitStorageFeatures){
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 features = (VkPhysicalDeviceFeatures2){
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &storageFeatures
+    };
+    vkGetPhysicalDeviceFeatures2(this->physicalDevice, &features);
+    return storageFeatures.storageBuffer16BitAccess == VK_TRUE;
+}
+
+static uint32_t CandleStorageSize(ComputeApplication this)
+{
+    return this->storagePrecision == COMPUTE_PRECISION_FP16 ? 4 * sizeof(uint16_t) : sizeof(Candlestick);
+}
+
+static uint32_t IndicatorStorageSize(ComputeApplication this)
+{
+    return this->storagePrecision == COMPUTE_PRECISION_FP16 ? sizeof(uint16_t) : sizeof(Indicator);
+}
+
+// Rounds an element offset up so that it can start a storage buffer descriptor.
+static uint64_t AlignElements(uint64_t elements, uint32_t elementSize, VkDeviceSize alignment)
+{
+    VkDeviceSize bytes = (elements * elementSize + alignment - 1) / alignment * alignment;
+    return (bytes + elementSize - 1) / elementSize;
+}
+
+// The resampled candles of every timeframe follow the source candles in the device
+// input buffer, and each timeframe gets its own region of the output buffer. The
+// regions are laid out in 64 bits, fails when a buffer would not fit the 32 bit sizes.
+static int LayoutTimeframes(ComputeApplication this)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+    uint64_t inputElements = this->inputDataElementsCount;
+    uint64_t outputElements = 0;
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        uint64_t inputOffset = AlignElements(inputElements, CandleStorageSize(this), alignment);
+        uint64_t outputOffset = AlignElements(outputElements, IndicatorStorageSize(this), alignment);
+        uint64_t elements = GetResampledCount(this->inputDataElementsCount, this->timeframes[t]);
+        inputElements = inputOffset + elements;
+        outputElements = outputOffset + elements;
+        if (inputElements * CandleStorageSize(this) > UINT32_MAX || outputElements * IndicatorStorageSize(this) > UINT32_MAX)
+            return 1;
+        this->timeframeElementsCount[t] = (uint32_t)elements;
+        this->timeframeInputOffset[t] = (uint32_t)inputOffset;
+        this->timeframeOutputOffset[t] = (uint32_t)outputOffset;
+    }
+    this->inputBufferSize = (uint32_t)(inputElements * CandleStorageSize(this));
+    this->outputBufferSize = (uint32_t)(outputElements * IndicatorStorageSize(this));
+    return 0;
+}
+
+// Correlation jobs upload one 32 bit return per element, half precision would
+// round away most of a return, and read back matrices or pairs.
+static void LayoutCorrelation(ComputeApplication this)
+{
+    this->storagePrecision = COMPUTE_PRECISION_FP32;
+    this->inputBufferSize = this->inputDataElementsCount * sizeof(float);
+    if (this->correlationPairs)
+        this->outputBufferSize = CORRELATION_PAIRS_HEADER + this->pairCapacity * sizeof(CorrelationPair);
+    else
+        this->outputBufferSize = this->correlationMatrixCount * this->symbolCount * this->symbolCount * sizeof(float);
+}
+
+// Picks the storage precision and buffer sizes, falling back to 32 bit storage
+// when the device cannot access 16 bit values in storage buffers. Fails when a
+// buffer of the job would not fit the 32 bit sizes.
+static int SelectStoragePrecision(ComputeApplication this, uint32_t requested)
+{
+    this->storagePrecision = COMPUTE_PRECISION_FP32;
+    if (requested == COMPUTE_PRECISION_FP16 && Supports16BitStorage(this))
+        this->storagePrecision = COMPUTE_PRECISION_FP16;
+
+    if ((uint64_t)this->inputDataElementsCount * CandleStorageSize(this) > UINT32_MAX)
+        return 1;
+    this->inputBufferSize = this->inputDataElementsCount * CandleStorageSize(this);
+    this->outputBufferSize = this->inputDataElementsCount * IndicatorStorageSize(this);
+    this->percentileBufferSize = this->rank ? this->inputDataElementsCount * sizeof(float) : 0;
+    if (this->timeframeCount > 0 && LayoutTimeframes(this) != 0)
+        return 1;
+    if (this->correlation)
+        LayoutCorrelation(this);
+    return 0;
+}
+
+static bool SupportsSubgroupArithmetic(ComputeApplication this)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1)
+        return false;
+
+    VkPhysicalDeviceSubgroupProperties subgroupProperties = (VkPhysicalDeviceSubgroupProperties){
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties2 = (VkPhysicalDeviceProperties2){
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &subgroupProperties
+    };
+    vkGetPhysicalDeviceProperties2(this->physicalDevice, &properties2);
+    VkSubgroupFeatureFlags required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+           (subgroupProperties.supportedOperations & required) == required;
+}
+
+// Picks the first pass implementation. The scan variants load overlapping tiles,
+// so they are only worth it while the PERIOD - 1 halo is a small part of a tile.
+static void SelectKernelVariant(ComputeApplication this, uint32_t requested)
+{
+    bool tiled = this->period * 2 <= this->workgroupSize;
+    if (requested == COMPUTE_KERNEL_AUTO)
+        requested = COMPUTE_KERNEL_SUBGROUP;
+
+    this->kernelVariant = COMPUTE_KERNEL_NAIVE;
+    if (requested == COMPUTE_KERNEL_SUBGROUP && tiled && SupportsSubgroupArithmetic(this))
+        this->kernelVariant = COMPUTE_KERNEL_SUBGROUP;
+    else if (requested >= COMPUTE_KERNEL_SHARED && tiled)
+        this->kernelVariant = COMPUTE_KERNEL_SHARED;
+}
+
+static bool IsWorkgroupSizeSupported(ComputeApplication this, uint32_t workgroupSize)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    if (workgroupSize == 0 ||
+        workgroupSize > properties.limits.maxComputeWorkGroupSize[0] ||
+        workgroupSize > properties.limits.maxComputeWorkGroupInvocations)
+        return false;
+    if (this->kernelVariant == COMPUTE_KERNEL_NAIVE)
+        return true;
+    // The scan variants keep up to two floats per invocation in shared memory.
+    return workgroupSize * 2 * sizeof(float) <= properties.limits.maxComputeSharedMemorySize &&
+           this->period * 2 <= workgroupSize;
+}
+
+// Every symbol of a cross-sectional job is a row of workgroups.
+static bool IsSymbolCountSupported(ComputeApplication this)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    return this->symbolCount <= properties.limits.maxComputeWorkGroupCount[1];
+}
+
+static uint32_t LargestSupportedWorkgroupSize(ComputeApplication this)
+{
+    for (uint32_t workgroupSize = DEFAULT_WORKGROUP_SIZE; workgroupSize >= 32; workgroupSize /= 2)
+    {
+        if (IsWorkgroupSizeSupported(this, workgroupSize))
+            return workgroupSize;
+    }
+    return 0;
+}
+
+static void TuningKey(ComputeApplication this, char* key, size_t length)
+{
+    snprintf(key, length, "sma-%s-%s", KernelVariantNames[this->kernelVariant], PrecisionNames[this->storagePrecision]);
+}
+
+// Uses the requested workgroup size, otherwise the one autotuned for this kernel
+// on the device. Without a tuned size the default is used and, for jobs large
+// enough to time, tuning is scheduled. Fails only for unsupported requested sizes.
+static bool SelectWorkgroupSize(ComputeApplication this, uint32_t requested)
+{
+    this->autotunePending = false;
+    if (requested != 0)
+    {
+        this->workgroupSize = requested;
+        return IsWorkgroupSizeSupported(this, requested);
+    }
+
+    char key[64];
+    TuningKey(this, key, sizeof(key));
+    uint32_t tuned = LoadTunedWorkgroupSize(this->pipelineCacheUUID, key);
+    if (tuned != 0 && IsWorkgroupSizeSupported(this, tuned))
+    {
+        this->workgroupSize = tuned;
+        return true;
+    }
+
+    this->workgroupSize = LargestSupportedWorkgroupSize(this);
+    if (this->workgroupSize == 0)
+    {
+        // Only reachable for long periods on small devices, the naive pass has no tile to fit.
+        this->kernelVariant = COMPUTE_KERNEL_NAIVE;
+        this->workgroupSize = LargestSupportedWorkgroupSize(this);
+    }
+    // Timeframe jobs dispatch several short regions, which would tune for the wrong shape.
+    this->autotunePending = tuned == 0 && this->timeframeCount == 0 && this->inputDataElementsCount >= AUTOTUNE_MIN_ELEMENTS;
+    return true;
+}
+
+static void InitializePipelineCache(ComputeApplication this)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    memcpy(this->pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    size_t size = 0;
+    void* data = LoadPipelineCacheData(this->pipelineCacheUUID, &size);
+    VkPipelineCacheCreateInfo createInfo = (VkPipelineCacheCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = size,
+        .pInitialData = data
+    };
+    // A rejected cache file is not fatal, the cache just starts out empty.
+    if (vkCreatePipelineCache(this->device, &createInfo, NULL, &this->pipelineCache) != VK_SUCCESS)
+    {
+        size = 0;
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = NULL;
+        VK_CHECK_RESULT(vkCreatePipelineCache(this->device, &createInfo, NULL, &this->pipelineCache));
+    }
+    this->pipelineCacheLoadedSize = size;
+    free(data);
+}
+
+static void StorePipelineCache(ComputeApplication this)
+{
+    size_t size = 0;
+    // The cache only grows, an unchanged size means nothing new was compiled.
+    if (vkGetPipelineCacheData(this->device, this->pipelineCache, &size, NULL) != VK_SUCCESS ||
+        size == this->pipelineCacheLoadedSize)
+        return;
+    void* data = malloc(size);
+    if (data != NULL && vkGetPipelineCacheData(this->device, this->pipelineCache, &size, data) == VK_SUCCESS)
+        StorePipelineCacheData(this->pipelineCacheUUID, data, size);
+    free(data);
+}
+
 static void InitializeVulkanDevice(ComputeApplication this)
 {
     this->queueFamilyIndex = getComputeQueueFamilyIndex(this);
@@ -157,8 +513,13 @@ static void InitializeVulkanDevice(ComputeApplication this)
         .pQueuePriorities = &queuePriorities
     };
     VkPhysicalDeviceFeatures deviceFeatures = {0};
+    VkPhysicalDevice16BitStorageFeatures storageFeatures = (VkPhysicalDevice16BitStorageFeatures){
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+        .storageBuffer16BitAccess = VK_TRUE
+    };
     VkDeviceCreateInfo deviceCreateInfo = (VkDeviceCreateInfo){
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = this->storagePrecision == COMPUTE_PRECISION_FP16 ? &storageFeatures : NULL,
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = NULL,
         .pQueueCreateInfos = &queueCreateInfo,
@@ -186,70 +547,40 @@ static uint32_t RetrieveMemoryType(ComputeApplication this, uint32_t memoryTypeB
     return -1;
 }
 
-static void InitializeBuffers(ComputeApplication this)
+static void CreateBuffer(ComputeApplication this, VkDeviceSize size, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* memory)
 {
     VkBufferCreateInfo bufferCreateInfo = (VkBufferCreateInfo){
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = this->inputBufferSize,
-        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
     };
-    VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, &this->inputBuffer));
+    VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, buffer));
 
     VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(this->device, this->inputBuffer, &memoryRequirements);
+    vkGetBufferMemoryRequirements(this->device, *buffer, &memoryRequirements);
     VkMemoryAllocateInfo allocateInfo = (VkMemoryAllocateInfo){
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         .allocationSize = memoryRequirements.size,
         .pNext = NULL,
-        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-    };
-
-    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, &this->inputBufferMemory));
-    VK_CHECK_RESULT(vkBindBufferMemory(this->device, this->inputBuffer, this->inputBufferMemory, 0));
-    // Device Only portion
-    VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, &this->deviceOnlyInputBuffer));
-    vkGetBufferMemoryRequirements(this->device, this->deviceOnlyInputBuffer, &memoryRequirements);
-    allocateInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .pNext = NULL,
-        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, &this->deviceOnlyInputBufferMemory));
-    VK_CHECK_RESULT(vkBindBufferMemory(this->device, this->deviceOnlyInputBuffer, this->deviceOnlyInputBufferMemory, 0));
-
-    // Output Buffer Related
-    bufferCreateInfo = (VkBufferCreateInfo){
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = sizeof(Indicator) * this->inputDataElementsCount,
-        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-    };
-    VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, &this->outputBuffer));
-
-    vkGetBufferMemoryRequirements(this->device, this->outputBuffer, &memoryRequirements);
-    allocateInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .pNext = NULL,
-        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, properties)
     };
+    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, memory));
+    VK_CHECK_RESULT(vkBindBufferMemory(this->device, *buffer, *memory, 0));
+}
 
-    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, &this->outputBufferMemory));
-    VK_CHECK_RESULT(vkBindBufferMemory(this->device, this->outputBuffer, this->outputBufferMemory, 0));
-
-    // Device Only Portion
-    VK_CHECK_RESULT(vkCreateBuffer(this->device, &bufferCreateInfo, NULL, &this->deviceOnlyOutputBuffer));
-    vkGetBufferMemoryRequirements(this->device, this->deviceOnlyOutputBuffer, &memoryRequirements);
-    allocateInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .pNext = NULL,
-        .memoryTypeIndex = RetrieveMemoryType(this, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    VK_CHECK_RESULT(vkAllocateMemory(this->device, &allocateInfo, NULL, &this->deviceOnlyOutputBufferMemory));
-    VK_CHECK_RESULT(vkBindBufferMemory(this->device, this->deviceOnlyOutputBuffer, this->deviceOnlyOutputBufferMemory, 0));
+// Each buffer has a host visible staging copy and a device local one the shaders work on.
+static void InitializeBuffers(ComputeApplication this)
+{
+    VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    CreateBuffer(this, this->inputBufferSize, hostVisible, &this->inputBuffer, &this->inputBufferMemory);
+    CreateBuffer(this, this->inputBufferSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->deviceOnlyInputBuffer, &this->deviceOnlyInputBufferMemory);
+    CreateBuffer(this, this->outputBufferSize, hostVisible, &this->outputBuffer, &this->outputBufferMemory);
+    CreateBuffer(this, this->outputBufferSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->deviceOnlyOutputBuffer, &this->deviceOnlyOutputBufferMemory);
+    if (!this->rank)
+        return;
+    CreateBuffer(this, this->percentileBufferSize, hostVisible, &this->percentileBuffer, &this->percentileBufferMemory);
+    CreateBuffer(this, this->percentileBufferSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->deviceOnlyPercentileBuffer, &this->deviceOnlyPercentileBufferMemory);
 }
 
 static void InitializeDescriptorSetLayout(ComputeApplication this)
@@ -272,46 +603,76 @@ static void InitializeDescriptorSetLayout(ComputeApplication this)
     VK_CHECK_RESULT(vkCreateDescriptorSetLayout(this->device, &descriptorSetLayoutCreateInfo, NULL, &this->descriptorSetLayout));
 }
 
-static void InitializeDescriptorSets(ComputeApplication this)
+static VkDescriptorSet AllocateDescriptorSet(ComputeApplication this, VkDescriptorBufferInfo input, VkDescriptorBufferInfo output)
 {
-    VkDescriptorPoolSize descriptorPoolSize = (VkDescriptorPoolSize){
-        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .descriptorCount = 2
-    };
-
-    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = (VkDescriptorPoolCreateInfo){
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = 1,
-        .poolSizeCount = 1,
-        .pPoolSizes = &descriptorPoolSize
-    };
-    VK_CHECK_RESULT(vkCreateDescriptorPool(this->device, &descriptorPoolCreateInfo, NULL, &this->descriptorPool));
-
+    VkDescriptorSet descriptorSet;
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = (VkDescriptorSetAllocateInfo){
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         .descriptorPool = this->descriptorPool,
         .descriptorSetCount = 1,
         .pSetLayouts = &this->descriptorSetLayout
     };
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(this->device, &descriptorSetAllocateInfo, &this->descriptorSet));
-
-    VkDescriptorBufferInfo descriptorBufferInfo[2];
-    descriptorBufferInfo[0].buffer = this->deviceOnlyInputBuffer;
-    descriptorBufferInfo[0].offset = 0;
-    descriptorBufferInfo[0].range = this->inputBufferSize;
-    descriptorBufferInfo[1].buffer = this->deviceOnlyOutputBuffer;
-    descriptorBufferInfo[1].offset = 0;
-    descriptorBufferInfo[1].range = sizeof(Indicator) * this->inputDataElementsCount;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(this->device, &descriptorSetAllocateInfo, &descriptorSet));
 
+    VkDescriptorBufferInfo descriptorBufferInfo[2] = { input, output };
     VkWriteDescriptorSet writeDescriptorSet = (VkWriteDescriptorSet){
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .dstSet = this->descriptorSet,
+        .dstSet = descriptorSet,
         .dstBinding = 0,
         .descriptorCount = 2,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pBufferInfo = descriptorBufferInfo
     };
     vkUpdateDescriptorSets(this->device, 1, &writeDescriptorSet, 0, NULL);
+    return descriptorSet;
+}
+
+static void InitializeDescriptorSets(ComputeApplication this)
+{
+    // One set for the whole buffers, plus a resampling and an SMA set per timeframe
+    // and one from the SMA to the percentiles.
+    uint32_t setCount = 1 + 2 * this->timeframeCount + (this->rank ? 1 : 0);
+    VkDescriptorPoolSize descriptorPoolSize = (VkDescriptorPoolSize){
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2 * setCount
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = (VkDescriptorPoolCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = setCount,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize
+    };
+    VK_CHECK_RESULT(vkCreateDescriptorPool(this->device, &descriptorPoolCreateInfo, NULL, &this->descriptorPool));
+
+    this->descriptorSet = AllocateDescriptorSet(this,
+        (VkDescriptorBufferInfo){ .buffer = this->deviceOnlyInputBuffer, .offset = 0, .range = this->inputBufferSize },
+        (VkDescriptorBufferInfo){ .buffer = this->deviceOnlyOutputBuffer, .offset = 0, .range = this->outputBufferSize });
+    if (this->rank)
+        this->rankDescriptorSet = AllocateDescriptorSet(this,
+            (VkDescriptorBufferInfo){ .buffer = this->deviceOnlyOutputBuffer, .offset = 0, .range = this->outputBufferSize },
+            (VkDescriptorBufferInfo){ .buffer = this->deviceOnlyPercentileBuffer, .offset = 0, .range = this->percentileBufferSize });
+
+    VkDescriptorBufferInfo source = (VkDescriptorBufferInfo){
+        .buffer = this->deviceOnlyInputBuffer,
+        .offset = 0,
+        .range = (VkDeviceSize)this->inputDataElementsCount * CandleStorageSize(this)
+    };
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        VkDescriptorBufferInfo candles = (VkDescriptorBufferInfo){
+            .buffer = this->deviceOnlyInputBuffer,
+            .offset = (VkDeviceSize)this->timeframeInputOffset[t] * CandleStorageSize(this),
+            .range = (VkDeviceSize)this->timeframeElementsCount[t] * CandleStorageSize(this)
+        };
+        VkDescriptorBufferInfo indicators = (VkDescriptorBufferInfo){
+            .buffer = this->deviceOnlyOutputBuffer,
+            .offset = (VkDeviceSize)this->timeframeOutputOffset[t] * IndicatorStorageSize(this),
+            .range = (VkDeviceSize)this->timeframeElementsCount[t] * IndicatorStorageSize(this)
+        };
+        this->resampleDescriptorSets[t] = AllocateDescriptorSet(this, source, candles);
+        this->timeframeDescriptorSets[t] = AllocateDescriptorSet(this, candles, indicators);
+    }
 }
 
 static uint32_t* readFile(const char *filename, uint32_t* outlength)
@@ -343,10 +704,106 @@ static uint32_t* readFile(const char *filename, uint32_t* outlength)
     return (uint32_t *)str;
 }
 
+// Every shader takes the workgroup size as specialization constant 0 and its
+// parameter, the period or the resampling factor, as constant 1.
+static VkPipeline CreatePipeline(ComputeApplication this, VkShaderModule module, uint32_t workgroupSize, uint32_t parameter)
+{
+    uint32_t constants[2] = { workgroupSize, parameter };
+    VkSpecializationMapEntry mapEntries[2] = {
+        { .constantID = 0, .offset = 0, .size = sizeof(uint32_t) },
+        { .constantID = 1, .offset = sizeof(uint32_t), .size = sizeof(uint32_t) }
+    };
+    VkSpecializationInfo specializationInfo = (VkSpecializationInfo){
+        .mapEntryCount = 2,
+        .pMapEntries = mapEntries,
+        .dataSize = sizeof(constants),
+        .pData = constants
+    };
+    VkComputePipelineCreateInfo pipelineCreateInfo = (VkComputePipelineCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = (VkPipelineShaderStageCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfo
+        },
+        .layout = this->pipelineLayout
+    };
+    VkPipeline pipeline;
+    VK_CHECK_RESULT(vkCreateComputePipelines(this->device, this->pipelineCache, 1, &pipelineCreateInfo, NULL, &pipeline));
+    return pipeline;
+}
+
+static VkPipeline CreateSmaPipeline(ComputeApplication this, VkShaderModule module, uint32_t workgroupSize)
+{
+    return CreatePipeline(this, module, workgroupSize, this->period);
+}
+
+static void CreateSmaPipelines(ComputeApplication this)
+{
+    this->smaFirstPassPipeline = CreateSmaPipeline(this, this->smaFirstPassShaderModule, this->workgroupSize);
+    this->smaSecondPassPipeline = CreateSmaPipeline(this, this->smaSecondPassShaderModule, this->workgroupSize);
+}
+
+// Every shader shares one layout, its push constants cover the series shape (see
+// PushShape) and the correlation parameters that follow it.
+static void InitializePipelineLayout(ComputeApplication this)
+{
+    VkPushConstantRange pushConstantRange = (VkPushConstantRange){
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(CorrelationShape)
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &this->descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    VK_CHECK_RESULT(vkCreatePipelineLayout(this->device, &pipelineLayoutCreateInfo, NULL, &this->pipelineLayout));
+}
+
+static void InitializeCorrelationPipeline(ComputeApplication this)
+{
+    VkShaderModuleCreateInfo createInfo = (VkShaderModuleCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pCode = this->correlationPairs ? correlationPairs_spv : correlation_spv,
+        .codeSize = this->correlationPairs ? sizeof(correlationPairs_spv) : sizeof(correlation_spv)
+    };
+    VK_CHECK_RESULT(vkCreateShaderModule(this->device, &createInfo, NULL, &this->correlationShaderModule));
+    // The local size is fixed, the window is the parameter.
+    this->correlationPipeline = CreatePipeline(this, this->correlationShaderModule, this->workgroupSize, this->correlationOptions.window);
+}
+
 static void InitializeComputePipelines(ComputeApplication this)
 {
-    uint32_t filelength = smaPass1_spv_len;
-    uint32_t *code = (uint32_t*) smaPass1_spv;
+    InitializePipelineLayout(this);
+    if (this->correlation)
+    {
+        InitializeCorrelationPipeline(this);
+        return;
+    }
+
+    uint32_t filelength = sizeof(smaPass1_spv);
+    const uint32_t *code = smaPass1_spv;
+    bool fp16 = this->storagePrecision == COMPUTE_PRECISION_FP16;
+    if (this->kernelVariant == COMPUTE_KERNEL_SUBGROUP)
+    {
+        filelength = fp16 ? sizeof(smaPass1SubgroupFp16_spv) : sizeof(smaPass1Subgroup_spv);
+        code = fp16 ? smaPass1SubgroupFp16_spv : smaPass1Subgroup_spv;
+    }
+    else if (this->kernelVariant == COMPUTE_KERNEL_SHARED)
+    {
+        filelength = fp16 ? sizeof(smaPass1SharedFp16_spv) : sizeof(smaPass1Shared_spv);
+        code = fp16 ? smaPass1SharedFp16_spv : smaPass1Shared_spv;
+    }
+    else if (fp16)
+    {
+        filelength = sizeof(smaPass1Fp16_spv);
+        code = smaPass1Fp16_spv;
+    }
     VkShaderModuleCreateInfo createInfo = (VkShaderModuleCreateInfo){
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pCode = code,
@@ -354,8 +811,8 @@ static void InitializeComputePipelines(ComputeApplication this)
     };
     VK_CHECK_RESULT(vkCreateShaderModule(this->device, &createInfo, NULL, &this->smaFirstPassShaderModule));
 
-    filelength = smaPass2_spv_len;
-    code = (uint32_t*) smaPass2_spv;
+    filelength = fp16 ? sizeof(smaPass2Fp16_spv) : sizeof(smaPass2_spv);
+    code = fp16 ? smaPass2Fp16_spv : smaPass2_spv;
     createInfo = (VkShaderModuleCreateInfo){
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pCode = code,
@@ -363,57 +820,158 @@ static void InitializeComputePipelines(ComputeApplication this)
     };
     VK_CHECK_RESULT(vkCreateShaderModule(this->device, &createInfo, NULL, &this->smaSecondPassShaderModule));
 
-    VkPipelineShaderStageCreateInfo smaPass1ShaderStageCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = this->smaFirstPassShaderModule,
-        .pName = "main"
-    };
+    CreateSmaPipelines(this);
+    if (this->rank)
+    {
+        createInfo = (VkShaderModuleCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .pCode = fp16 ? rankFp16_spv : rank_spv,
+            .codeSize = fp16 ? sizeof(rankFp16_spv) : sizeof(rank_spv)
+        };
+        VK_CHECK_RESULT(vkCreateShaderModule(this->device, &createInfo, NULL, &this->rankShaderModule));
+        // The rank shader has a fixed local size and no parameter, the constants are ignored.
+        this->rankPipeline = CreatePipeline(this, this->rankShaderModule, this->workgroupSize, 0);
+    }
+    if (this->timeframeCount == 0)
+        return;
 
-    VkPipelineShaderStageCreateInfo smaPass2ShaderStageCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = this->smaSecondPassShaderModule,
-        .pName = "main"
+    createInfo = (VkShaderModuleCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pCode = fp16 ? resampleFp16_spv : resample_spv,
+        .codeSize = fp16 ? sizeof(resampleFp16_spv) : sizeof(resample_spv)
     };
+    VK_CHECK_RESULT(vkCreateShaderModule(this->device, &createInfo, NULL, &this->resampleShaderModule));
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+        this->resamplePipelines[t] = CreatePipeline(this, this->resampleShaderModule, this->workgroupSize, this->timeframes[t]);
+}
 
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 1,
-        .pSetLayouts = &this->descriptorSetLayout
+static void InitializeTimestampQueries(ComputeApplication this)
+{
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, queueFamilies);
+    uint32_t validBits = queueFamilies[this->queueFamilyIndex].timestampValidBits;
+    if (validBits == 0)
+        return;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+    this->timestampPeriod = properties.limits.timestampPeriod;
+    this->timestampMask = validBits >= 64 ? UINT64_MAX : ((1ull << validBits) - 1);
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = (VkQueryPoolCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = TIMESTAMP_COUNT
     };
-    VK_CHECK_RESULT(vkCreatePipelineLayout(this->device, &pipelineLayoutCreateInfo, NULL, &this->pipelineLayout));
+    VK_CHECK_RESULT(vkCreateQueryPool(this->device, &queryPoolCreateInfo, NULL, &this->queryPool));
+}
 
-    VkComputePipelineCreateInfo smaPass1PipelineCreateInfo = {0};
-    VkComputePipelineCreateInfo smaPass2PipelineCreateInfo = {0};
+static void WriteTimestamp(ComputeApplication this, VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query)
+{
+    if (this->queryPool != VK_NULL_HANDLE)
+        vkCmdWriteTimestamp(commandBuffer, stage, this->queryPool, query);
+}
 
-    smaPass1PipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    smaPass1PipelineCreateInfo.stage = smaPass1ShaderStageCreateInfo;
-    smaPass1PipelineCreateInfo.layout = this->pipelineLayout;
+static void ReadTimestamps(ComputeApplication this, ComputeStats* stats)
+{
+    // Value and availability of every query. Without the wait bit the pairs of the
+    // stages a job did not run simply come back unavailable.
+    uint64_t results[TIMESTAMP_COUNT][2];
+    if (this->queryPool == VK_NULL_HANDLE)
+        return;
+    VkResult result = vkGetQueryPoolResults(this->device, this->queryPool, 0, TIMESTAMP_COUNT, sizeof(results), results, sizeof(results[0]),
+                                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY)
+        return;
 
-    smaPass2PipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    smaPass2PipelineCreateInfo.stage = smaPass2ShaderStageCreateInfo;
-    smaPass2PipelineCreateInfo.layout = this->pipelineLayout;
+    double tickMs = this->timestampPeriod / 1000000.0;
+#define TIMESTAMP_AVAILABLE(begin, end) (results[begin][1] != 0 && results[end][1] != 0)
+#define TIMESTAMP_ELAPSED_MS(begin, end) \
+    (TIMESTAMP_AVAILABLE(begin, end) ? (double)((results[end][0] - results[begin][0]) & this->timestampMask) * tickMs : 0)
+    // Correlation jobs run no SMA pass, every job uploads and reads back.
+    if (!TIMESTAMP_AVAILABLE(TIMESTAMP_UPLOAD_BEGIN, TIMESTAMP_UPLOAD_END) ||
+        !TIMESTAMP_AVAILABLE(TIMESTAMP_READBACK_BEGIN, TIMESTAMP_READBACK_END))
+        return;
+    stats->gpuUploadMs = TIMESTAMP_ELAPSED_MS(TIMESTAMP_UPLOAD_BEGIN, TIMESTAMP_UPLOAD_END);
+    stats->gpuSmaPass1Ms = TIMESTAMP_ELAPSED_MS(TIMESTAMP_SMA_PASS1_BEGIN, TIMESTAMP_SMA_PASS1_END);
+    stats->gpuSmaPass2Ms = TIMESTAMP_ELAPSED_MS(TIMESTAMP_SMA_PASS2_BEGIN, TIMESTAMP_SMA_PASS2_END);
+    stats->gpuReadbackMs = TIMESTAMP_ELAPSED_MS(TIMESTAMP_READBACK_BEGIN, TIMESTAMP_READBACK_END);
+    stats->gpuResampleMs = TIMESTAMP_ELAPSED_MS(TIMESTAMP_RESAMPLE_BEGIN, TIMESTAMP_RESAMPLE_END);
+    stats->gpuRankMs = TIMESTAMP_ELAPSED_MS(TIMESTAMP_RANK_BEGIN, TIMESTAMP_RANK_END);
+    stats->gpuCorrelationMs = TIMESTAMP_ELAPSED_MS(TIMESTAMP_CORRELATION_BEGIN, TIMESTAMP_CORRELATION_END);
+#undef TIMESTAMP_ELAPSED_MS
+#undef TIMESTAMP_AVAILABLE
+    stats->gpuTimestampsValid = 1;
+}
 
-    VK_CHECK_RESULT(vkCreateComputePipelines(
-        this->device, VK_NULL_HANDLE,
-        1, &smaPass1PipelineCreateInfo,
-        NULL, &this->smaFirstPassPipeline));
+static uint32_t DispatchGroupCount(uint32_t elements, uint32_t workgroupSize)
+{
+    return (elements + workgroupSize - 1) / workgroupSize;
+}
 
-    VK_CHECK_RESULT(vkCreateComputePipelines(
-        this->device, VK_NULL_HANDLE,
-        1, &smaPass2PipelineCreateInfo,
-        NULL, &this->smaSecondPassPipeline));
+static uint32_t Pass1DispatchGroupCount(ComputeApplication this, uint32_t elements, uint32_t workgroupSize)
+{
+    // The scan variants emit workgroupSize - (period - 1) outputs per group.
+    if (this->kernelVariant != COMPUTE_KERNEL_NAIVE)
+    {
+        uint32_t tileOutputs = workgroupSize - (this->period - 1);
+        return (elements + tileOutputs - 1) / tileOutputs;
+    }
+    return DispatchGroupCount(elements, workgroupSize);
 }
 
-static void InitializeCommandBuffers(ComputeApplication this)
+static void RecordBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                          VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
 {
-    VkCommandPoolCreateInfo commandPoolCreateInfo = (VkCommandPoolCreateInfo){
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = 0,
-        .queueFamilyIndex = this->queueFamilyIndex
+    VkMemoryBarrier barrier = (VkMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess
     };
-    VK_CHECK_RESULT(vkCreateCommandPool(this->device, &commandPoolCreateInfo, NULL, &this->commandPool));
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Sets the series layout read by the SMA and rank shaders, see the Shape block in the shaders.
+static void PushShape(ComputeApplication this, VkCommandBuffer commandBuffer, uint32_t timeCount, uint32_t rowStride, uint32_t rowCount)
+{
+    uint32_t shape[3] = { timeCount, rowStride, rowCount };
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(shape), shape);
+}
+
+// Dispatches the bound SMA pass over rowCount series of timeCount elements, one row of workgroups per series.
+static void RecordSmaDispatch(ComputeApplication this, VkCommandBuffer commandBuffer, bool firstPass, uint32_t workgroupSize,
+                              uint32_t timeCount, uint32_t rowStride, uint32_t rowCount)
+{
+    PushShape(this, commandBuffer, timeCount, rowStride, rowCount);
+    uint32_t groupCount = firstPass ? Pass1DispatchGroupCount(this, timeCount, workgroupSize) : DispatchGroupCount(timeCount, workgroupSize);
+    vkCmdDispatch(commandBuffer, groupCount, rowCount, 1);
+}
+
+// Ranks every SMA among the symbols at the same time, after both passes wrote them.
+static void RecordRank(ComputeApplication this, VkCommandBuffer commandBuffer)
+{
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_RANK_BEGIN);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->rankPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->rankDescriptorSet, 0, NULL);
+    PushShape(this, commandBuffer, this->timeCount, this->rowStride, this->symbolCount);
+    vkCmdDispatch(commandBuffer, DispatchGroupCount(this->timeCount, RANK_TILE_TIMES), DispatchGroupCount(this->symbolCount, RANK_TILE_ROWS), 1);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_RANK_END);
+}
+
+// Streams submit the same command buffers for every chunk, single jobs submit them once.
+static VkCommandBufferUsageFlags CommandBufferUsage(ComputeApplication this)
+{
+    return this->reusable ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+}
+
+// Records both SMA passes and the optional ranking, separate from the copies so
+// they can be re-recorded with new pipelines once the workgroup size has been tuned.
+static void RecordSmaCommandBuffers(ComputeApplication this)
+{
     VkCommandBufferAllocateInfo commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = this->commandPool,
@@ -422,49 +980,323 @@ static void InitializeCommandBuffers(ComputeApplication this)
     };
     VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->smaPass1CommandBuffer));
     VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->smaPass2CommandBuffer));
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->copyInputBufferToDeviceCommand));
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->copyFromDeviceOutputCommand));
     VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-    };
-    VkBufferCopy bufferCopy = (VkBufferCopy){
-        .size = this->inputBufferSize,
-        .dstOffset = 0,
-        .srcOffset = 0
+        .flags = CommandBufferUsage(this)
     };
 
-    VK_CHECK_RESULT(vkBeginCommandBuffer(this->copyInputBufferToDeviceCommand, &beginInfo));
-    vkCmdCopyBuffer(this->copyInputBufferToDeviceCommand, this->inputBuffer, this->deviceOnlyInputBuffer, 1, &bufferCopy);
-    VK_CHECK_RESULT(vkEndCommandBuffer(this->copyInputBufferToDeviceCommand));
-
     VK_CHECK_RESULT(vkBeginCommandBuffer(this->smaPass1CommandBuffer, &beginInfo));
+    WriteTimestamp(this, this->smaPass1CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_SMA_PASS1_BEGIN);
     vkCmdBindPipeline(this->smaPass1CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->smaFirstPassPipeline);
     vkCmdBindDescriptorSets(this->smaPass1CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 0, NULL);
-    vkCmdDispatch(this->smaPass1CommandBuffer, (uint32_t)ceil((double)this->inputBufferSize / (double)WORKGROUP_SIZE) + 1, 1, 1);
+    RecordSmaDispatch(this, this->smaPass1CommandBuffer, true, this->workgroupSize, this->timeCount, this->rowStride, this->symbolCount);
+    WriteTimestamp(this, this->smaPass1CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_SMA_PASS1_END);
     VK_CHECK_RESULT(vkEndCommandBuffer(this->smaPass1CommandBuffer));
 
     VK_CHECK_RESULT(vkBeginCommandBuffer(this->smaPass2CommandBuffer, &beginInfo));
+    WriteTimestamp(this, this->smaPass2CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_SMA_PASS2_BEGIN);
     vkCmdBindPipeline(this->smaPass2CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->smaSecondPassPipeline);
     vkCmdBindDescriptorSets(this->smaPass2CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 0, NULL);
-    vkCmdDispatch(this->smaPass2CommandBuffer, (uint32_t)ceil((double)this->inputBufferSize / (double)WORKGROUP_SIZE), 1, 1);
+    RecordSmaDispatch(this, this->smaPass2CommandBuffer, false, this->workgroupSize, this->timeCount, this->rowStride, this->symbolCount);
+    WriteTimestamp(this, this->smaPass2CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_SMA_PASS2_END);
+    if (this->rank)
+        RecordRank(this, this->smaPass2CommandBuffer);
     VK_CHECK_RESULT(vkEndCommandBuffer(this->smaPass2CommandBuffer));
-
-    bufferCopy = (VkBufferCopy){
-        .size = this->inputDataElementsCount * sizeof(Indicator),
-        .dstOffset = 0,
-        .srcOffset = 0
-    };
-
-    VK_CHECK_RESULT(vkBeginCommandBuffer(this->copyFromDeviceOutputCommand, &beginInfo));
-    vkCmdCopyBuffer(this->copyFromDeviceOutputCommand, this->deviceOnlyOutputBuffer, this->outputBuffer, 1, &bufferCopy);
-    VK_CHECK_RESULT(vkEndCommandBuffer(this->copyFromDeviceOutputCommand));
 }
 
-static void ExecuteComputeShaders(ComputeApplication this)
+// Records a whole timeframe job into one command buffer: the upload, the resampling
+// of every timeframe, both SMA passes over each resampled region and the readback.
+// Barriers order the stages, so the resampled candles stay on the device.
+static void RecordTimeframeCommandBuffer(ComputeApplication this)
 {
-    VkSubmitInfo inputBufferCopySubmitInfo = (VkSubmitInfo){
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = this->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->jobCommandBuffer));
+    VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkCommandBuffer commandBuffer = this->jobCommandBuffer;
+    VkDeviceSize sourceSize = (VkDeviceSize)this->inputDataElementsCount * CandleStorageSize(this);
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    if (this->queryPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(commandBuffer, this->queryPool, 0, TIMESTAMP_COUNT);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_UPLOAD_BEGIN);
+    VkBufferCopy bufferCopy = (VkBufferCopy){ .srcOffset = 0, .dstOffset = 0, .size = sourceSize };
+    vkCmdCopyBuffer(commandBuffer, this->inputBuffer, this->deviceOnlyInputBuffer, 1, &bufferCopy);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_UPLOAD_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_RESAMPLE_BEGIN);
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->resamplePipelines[t]);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->resampleDescriptorSets[t], 0, NULL);
+        vkCmdDispatch(commandBuffer, DispatchGroupCount(this->timeframeElementsCount[t], this->workgroupSize), 1, 1);
+    }
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_RESAMPLE_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_SMA_PASS1_BEGIN);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->smaFirstPassPipeline);
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->timeframeDescriptorSets[t], 0, NULL);
+        RecordSmaDispatch(this, commandBuffer, true, this->workgroupSize, this->timeframeElementsCount[t], this->timeframeElementsCount[t], 1);
+    }
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_SMA_PASS1_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_SMA_PASS2_BEGIN);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->smaSecondPassPipeline);
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->timeframeDescriptorSets[t], 0, NULL);
+        RecordSmaDispatch(this, commandBuffer, false, this->workgroupSize, this->timeframeElementsCount[t], this->timeframeElementsCount[t], 1);
+    }
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_SMA_PASS2_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    // The resampled candles are read back into the staging buffer, behind the source candles.
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_READBACK_BEGIN);
+    bufferCopy = (VkBufferCopy){ .srcOffset = 0, .dstOffset = 0, .size = this->outputBufferSize };
+    vkCmdCopyBuffer(commandBuffer, this->deviceOnlyOutputBuffer, this->outputBuffer, 1, &bufferCopy);
+    bufferCopy = (VkBufferCopy){ .srcOffset = sourceSize, .dstOffset = sourceSize, .size = this->inputBufferSize - sourceSize };
+    vkCmdCopyBuffer(commandBuffer, this->deviceOnlyInputBuffer, this->inputBuffer, 1, &bufferCopy);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_READBACK_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+}
+
+// Records a whole correlation job into one command buffer: the upload of the
+// returns, the reset of the pair count, the correlation pass and the readback.
+static void RecordCorrelationCommandBuffer(ComputeApplication this)
+{
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = this->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->jobCommandBuffer));
+    VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkCommandBuffer commandBuffer = this->jobCommandBuffer;
+    CorrelationShape shape = (CorrelationShape){
+        .timeCount = this->timeCount,
+        .rowStride = this->rowStride,
+        .rowCount = this->symbolCount,
+        .step = this->correlationOptions.step,
+        .matrixCount = this->correlationMatrixCount,
+        .pairCapacity = this->pairCapacity,
+        .threshold = this->correlationOptions.threshold,
+        .covariance = this->correlationOptions.covariance
+    };
+    uint32_t groupCount = DispatchGroupCount(this->symbolCount, CORRELATION_TILE);
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    if (this->queryPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(commandBuffer, this->queryPool, 0, TIMESTAMP_COUNT);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_UPLOAD_BEGIN);
+    VkBufferCopy bufferCopy = (VkBufferCopy){ .srcOffset = 0, .dstOffset = 0, .size = this->inputBufferSize };
+    vkCmdCopyBuffer(commandBuffer, this->inputBuffer, this->deviceOnlyInputBuffer, 1, &bufferCopy);
+    if (this->correlationPairs)
+        vkCmdFillBuffer(commandBuffer, this->deviceOnlyOutputBuffer, 0, CORRELATION_PAIRS_HEADER, 0);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_UPLOAD_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_CORRELATION_BEGIN);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->correlationPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(shape), &shape);
+    vkCmdDispatch(commandBuffer, groupCount, groupCount, 1);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_CORRELATION_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_READBACK_BEGIN);
+    bufferCopy = (VkBufferCopy){ .srcOffset = 0, .dstOffset = 0, .size = this->outputBufferSize };
+    vkCmdCopyBuffer(commandBuffer, this->deviceOnlyOutputBuffer, this->outputBuffer, 1, &bufferCopy);
+    WriteTimestamp(this, commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_READBACK_END);
+    RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+}
+
+// Records the upload of inputSize bytes of candles and the readback of outputSize
+// bytes of SMA, plus the percentiles when ranking.
+static void RecordCopyCommandBuffers(ComputeApplication this, VkDeviceSize inputSize, VkDeviceSize outputSize)
+{
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = this->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->copyInputBufferToDeviceCommand));
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &this->copyFromDeviceOutputCommand));
+    VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = CommandBufferUsage(this)
+    };
+    VkBufferCopy bufferCopy = (VkBufferCopy){
+        .size = inputSize,
+        .dstOffset = 0,
+        .srcOffset = 0
+    };
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(this->copyInputBufferToDeviceCommand, &beginInfo));
+    // The command buffers are submitted in order, so the first one resets every query.
+    if (this->queryPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(this->copyInputBufferToDeviceCommand, this->queryPool, 0, TIMESTAMP_COUNT);
+    WriteTimestamp(this, this->copyInputBufferToDeviceCommand, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_UPLOAD_BEGIN);
+    vkCmdCopyBuffer(this->copyInputBufferToDeviceCommand, this->inputBuffer, this->deviceOnlyInputBuffer, 1, &bufferCopy);
+    WriteTimestamp(this, this->copyInputBufferToDeviceCommand, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_UPLOAD_END);
+    VK_CHECK_RESULT(vkEndCommandBuffer(this->copyInputBufferToDeviceCommand));
+
+    bufferCopy = (VkBufferCopy){
+        .size = outputSize,
+        .dstOffset = 0,
+        .srcOffset = 0
+    };
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(this->copyFromDeviceOutputCommand, &beginInfo));
+    WriteTimestamp(this, this->copyFromDeviceOutputCommand, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_READBACK_BEGIN);
+    vkCmdCopyBuffer(this->copyFromDeviceOutputCommand, this->deviceOnlyOutputBuffer, this->outputBuffer, 1, &bufferCopy);
+    if (this->rank)
+    {
+        bufferCopy.size = this->percentileBufferSize;
+        vkCmdCopyBuffer(this->copyFromDeviceOutputCommand, this->deviceOnlyPercentileBuffer, this->percentileBuffer, 1, &bufferCopy);
+    }
+    WriteTimestamp(this, this->copyFromDeviceOutputCommand, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_READBACK_END);
+    VK_CHECK_RESULT(vkEndCommandBuffer(this->copyFromDeviceOutputCommand));
+}
+
+static void InitializeCommandBuffers(ComputeApplication this)
+{
+    VkCommandPoolCreateInfo commandPoolCreateInfo = (VkCommandPoolCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = 0,
+        .queueFamilyIndex = this->queueFamilyIndex
+    };
+    VK_CHECK_RESULT(vkCreateCommandPool(this->device, &commandPoolCreateInfo, NULL, &this->commandPool));
+    if (this->timeframeCount > 0)
+    {
+        RecordTimeframeCommandBuffer(this);
+        return;
+    }
+    if (this->correlation)
+    {
+        RecordCorrelationCommandBuffer(this);
+        return;
+    }
+    RecordCopyCommandBuffers(this, this->inputBufferSize, this->outputBufferSize);
+    RecordSmaCommandBuffers(this);
+}
+
+static double TimeFirstPass(ComputeApplication this, VkPipeline pipeline, uint32_t workgroupSize, VkFence fence)
+{
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = this->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkCommandBuffer commandBuffer;
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(this->device, &commandBufferAllocateInfo, &commandBuffer));
+    VkCommandBufferBeginInfo beginInfo = (VkCommandBufferBeginInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    };
+    VkMemoryBarrier barrier = (VkMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT
+    };
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 0, NULL);
+    for (uint32_t i = 0; i < AUTOTUNE_DISPATCHES; ++i)
+    {
+        if (i > 0)
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+        RecordSmaDispatch(this, commandBuffer, true, workgroupSize, this->timeCount, this->rowStride, this->symbolCount);
+    }
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+    VkSubmitInfo submitInfo = (VkSubmitInfo){
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+    // The first submission warms up caches and clocks, only the second one is timed.
+    double elapsed = 0;
+    for (int run = 0; run < 2; ++run)
+    {
+        double start = ComputeTimestampMs();
+        VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &submitInfo, fence));
+        VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+        VK_CHECK_RESULT(vkResetFences(this->device, 1, &fence));
+        elapsed = ComputeTimestampMs() - start;
+    }
+    vkFreeCommandBuffers(this->device, this->commandPool, 1, &commandBuffer);
+    return elapsed;
+}
+
+// Times the first pass at every candidate workgroup size on the uploaded job and
+// keeps the fastest for both passes. Pass 1 only writes its output, so repeating
+// it before the real run is harmless. The winner is stored per device and kernel.
+static void AutotuneWorkgroupSize(ComputeApplication this, VkFence fence)
+{
+    uint32_t best = this->workgroupSize;
+    double bestMs = 0;
+    for (size_t i = 0; i < sizeof(AutotuneCandidates) / sizeof(AutotuneCandidates[0]); ++i)
+    {
+        uint32_t candidate = AutotuneCandidates[i];
+        if (!IsWorkgroupSizeSupported(this, candidate))
+            continue;
+        VkPipeline pipeline = CreateSmaPipeline(this, this->smaFirstPassShaderModule, candidate);
+        double elapsed = TimeFirstPass(this, pipeline, candidate, fence);
+        vkDestroyPipeline(this->device, pipeline, NULL);
+        if (bestMs == 0 || elapsed < bestMs)
+        {
+            best = candidate;
+            bestMs = elapsed;
+        }
+    }
+
+    char key[64];
+    TuningKey(this, key, sizeof(key));
+    StoreTunedWorkgroupSize(this->pipelineCacheUUID, key, best);
+    this->autotunePending = false;
+    if (best == this->workgroupSize)
+        return;
+
+    VkCommandBuffer commandBuffers[2] = { this->smaPass1CommandBuffer, this->smaPass2CommandBuffer };
+    vkFreeCommandBuffers(this->device, this->commandPool, 2, commandBuffers);
+    vkDestroyPipeline(this->device, this->smaFirstPassPipeline, NULL);
+    vkDestroyPipeline(this->device, this->smaSecondPassPipeline, NULL);
+    this->workgroupSize = best;
+    CreateSmaPipelines(this);
+    RecordSmaCommandBuffers(this);
+}
+
+static void ExecuteComputeShaders(ComputeApplication this, ComputeStats* stats)
+{
+    VkSubmitInfo inputBufferCopySubmitInfo = (VkSubmitInfo){
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .commandBufferCount = 1,
         .pCommandBuffers = &this->copyInputBufferToDeviceCommand
     };
@@ -490,20 +1322,79 @@ static void ExecuteComputeShaders(ComputeApplication this)
     };
     VK_CHECK_RESULT(vkCreateFence(this->device, &fenceCreateInfo, NULL, &fence));
 
+    double start = ComputeTimestampMs();
     VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &inputBufferCopySubmitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+    VK_CHECK_RESULT(vkResetFences(this->device, 1, &fence));
+    double uploaded = ComputeTimestampMs();
+    // A stream tunes on the first push that covers enough candles, not on a short one.
+    if (this->autotunePending && (!this->reusable || this->timeCount >= AUTOTUNE_MIN_ELEMENTS))
+    {
+        AutotuneWorkgroupSize(this, fence);
+        // The pass command buffers may have been re-recorded.
+        smaPass1SubmitInfo.pCommandBuffers = &this->smaPass1CommandBuffer;
+        smaPass2SubmitInfo.pCommandBuffers = &this->smaPass2CommandBuffer;
+    }
+    double tuned = ComputeTimestampMs();
     VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &smaPass1SubmitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+    VK_CHECK_RESULT(vkResetFences(this->device, 1, &fence));
     VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &smaPass2SubmitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+    VK_CHECK_RESULT(vkResetFences(this->device, 1, &fence));
+    double computed = ComputeTimestampMs();
     VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &outputBufferCopySubmitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+    double readback = ComputeTimestampMs();
+
+    if (stats != NULL)
+    {
+        stats->uploadMs += uploaded - start;
+        stats->autotuneMs += tuned - uploaded;
+        stats->computeMs += computed - tuned;
+        stats->readbackMs += readback - computed;
+        ReadTimestamps(this, stats);
+    }
+
+    vkDestroyFence(this->device, fence, NULL);
+}
+
+static void ExecuteJobCommandBuffer(ComputeApplication this, ComputeStats* stats)
+{
+    VkSubmitInfo submitInfo = (VkSubmitInfo){
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &this->jobCommandBuffer
+    };
+    VkFence fence;
+    VkFenceCreateInfo fenceCreateInfo = (VkFenceCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = 0
+    };
+    VK_CHECK_RESULT(vkCreateFence(this->device, &fenceCreateInfo, NULL, &fence));
+
+    double start = ComputeTimestampMs();
+    VK_CHECK_RESULT(vkQueueSubmit(this->queue, 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkWaitForFences(this->device, 1, &fence, VK_TRUE, 100000000000));
+    // A single submission, so the device side upload and readback count as compute here.
+    if (stats != NULL)
+    {
+        stats->computeMs += ComputeTimestampMs() - start;
+        ReadTimestamps(this, stats);
+    }
 
     vkDestroyFence(this->device, fence, NULL);
 }
 
 static void CleanUpVulkan(ComputeApplication this)
 {
+    if (this->pipelineCache != VK_NULL_HANDLE)
+    {
+        StorePipelineCache(this);
+        vkDestroyPipelineCache(this->device, this->pipelineCache, NULL);
+    }
+    if (this->queryPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(this->device, this->queryPool, NULL);
     vkFreeMemory(this->device, this->inputBufferMemory, NULL);
     vkFreeMemory(this->device, this->outputBufferMemory, NULL);
     vkFreeMemory(this->device, this->deviceOnlyInputBufferMemory, NULL);
@@ -512,8 +1403,19 @@ static void CleanUpVulkan(ComputeApplication this)
     vkDestroyBuffer(this->device, this->outputBuffer, NULL);
     vkDestroyBuffer(this->device, this->deviceOnlyInputBuffer, NULL);
     vkDestroyBuffer(this->device, this->deviceOnlyOutputBuffer, NULL);
+    vkFreeMemory(this->device, this->percentileBufferMemory, NULL);
+    vkFreeMemory(this->device, this->deviceOnlyPercentileBufferMemory, NULL);
+    vkDestroyBuffer(this->device, this->percentileBuffer, NULL);
+    vkDestroyBuffer(this->device, this->deviceOnlyPercentileBuffer, NULL);
     vkDestroyShaderModule(this->device, this->smaFirstPassShaderModule, NULL);
     vkDestroyShaderModule(this->device, this->smaSecondPassShaderModule, NULL);
+    vkDestroyShaderModule(this->device, this->resampleShaderModule, NULL);
+    vkDestroyShaderModule(this->device, this->rankShaderModule, NULL);
+    vkDestroyPipeline(this->device, this->rankPipeline, NULL);
+    vkDestroyShaderModule(this->device, this->correlationShaderModule, NULL);
+    vkDestroyPipeline(this->device, this->correlationPipeline, NULL);
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+        vkDestroyPipeline(this->device, this->resamplePipelines[t], NULL);
     vkDestroyDescriptorPool(this->device, this->descriptorPool, NULL);
     vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, NULL);
     vkDestroyPipelineLayout(this->device, this->pipelineLayout, NULL);
@@ -528,6 +1430,10 @@ static void LoadSampleFile(ComputeApplication this)
 {
     this->inputData = readFile("sample.dat", &this->inputBufferSize);
     this->inputDataElementsCount = this->inputBufferSize / sizeof(Candlestick);
+    this->outputBufferSize = this->inputDataElementsCount * sizeof(Indicator);
+    this->symbolCount = 1;
+    this->timeCount = this->inputDataElementsCount;
+    this->rowStride = this->inputDataElementsCount;
 }
 
 static void CopySampleDataIntoInputBuffer(ComputeApplication this)
@@ -565,39 +1471,562 @@ void run(ComputeApplication this)
     InitializeComputePipelines(this);
     InitializeCommandBuffers(this);
     CopySampleDataIntoInputBuffer(this);
-    ExecuteComputeShaders(this);
+    ExecuteComputeShaders(this, NULL);
     PrintAllResults(this);
     CleanUpVulkan(this);
 }
 
-static ComputeApplication app;
-
 int ComputeResult(Candlestick* kline, size_t kline_elements_count, Indicator* output)
 {
-    if (output == NULL || kline == NULL || kline_elements_count <= 0)
+    return ComputeResultEx(kline, kline_elements_count, output, NULL, NULL);
+}
+
+// Copies each timeframe region out of the mapped buffers, packing them back to back.
+static void ReadTimeframeResults(ComputeApplication this, Candlestick* resampled, Indicator* output)
+{
+    char* indicators = NULL;
+    char* candles = NULL;
+    bool fp16 = this->storagePrecision == COMPUTE_PRECISION_FP16;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->outputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&indicators));
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->inputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&candles));
+    size_t offset = 0;
+    for (uint32_t t = 0; t < this->timeframeCount; ++t)
+    {
+        uint32_t count = this->timeframeElementsCount[t];
+        const char* region = indicators + (size_t)this->timeframeOutputOffset[t] * IndicatorStorageSize(this);
+        if (fp16)
+            ConvertHalfToIndicators((const uint16_t*)region, output + offset, count);
+        else
+            memcpy(output + offset, region, sizeof(Indicator) * count);
+        if (resampled != NULL)
+        {
+            region = candles + (size_t)this->timeframeInputOffset[t] * CandleStorageSize(this);
+            if (fp16)
+                ConvertHalfToCandles((const uint16_t*)region, resampled + offset, count);
+            else
+                memcpy(resampled + offset, region, sizeof(Candlestick) * count);
+        }
+        offset += count;
+    }
+    vkUnmapMemory(this->device, this->inputBufferMemory);
+    vkUnmapMemory(this->device, this->outputBufferMemory);
+}
+
+// Rows of a cross-sectional job are padded to ROW_ALIGNMENT_ELEMENTS, a single series needs no padding.
+static size_t RowStride(uint32_t symbol_count, size_t time_count)
+{
+    if (symbol_count == 1)
+        return time_count;
+    return (time_count + ROW_ALIGNMENT_ELEMENTS - 1) / ROW_ALIGNMENT_ELEMENTS * ROW_ALIGNMENT_ELEMENTS;
+}
+
+// Copies the candles into the mapped staging buffer, one row per symbol.
+static void UploadRows(ComputeApplication this, const Candlestick* kline)
+{
+    char* mappedMemory = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->inputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&mappedMemory));
+    for (uint32_t s = 0; s < this->symbolCount; ++s)
+    {
+        const Candlestick* source = kline + (size_t)s * this->timeCount;
+        char* row = mappedMemory + (size_t)s * this->rowStride * CandleStorageSize(this);
+        if (this->storagePrecision == COMPUTE_PRECISION_FP16)
+            ConvertCandlesToHalf(source, (uint16_t*)row, this->timeCount);
+        else
+            memcpy(row, source, sizeof(Candlestick) * this->timeCount);
+    }
+    vkUnmapMemory(this->device, this->inputBufferMemory);
+}
+
+// Packs the rows of the mapped result buffers back to back, dropping the padding.
+static void ReadRows(ComputeApplication this, Indicator* output, float* percentile)
+{
+    char* outputMem = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->outputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&outputMem));
+    for (uint32_t s = 0; s < this->symbolCount; ++s)
+    {
+        const char* row = outputMem + (size_t)s * this->rowStride * IndicatorStorageSize(this);
+        if (this->storagePrecision == COMPUTE_PRECISION_FP16)
+            ConvertHalfToIndicators((const uint16_t*)row, output + (size_t)s * this->timeCount, this->timeCount);
+        else
+            memcpy(output + (size_t)s * this->timeCount, row, sizeof(Indicator) * this->timeCount);
+    }
+    vkUnmapMemory(this->device, this->outputBufferMemory);
+    if (!this->rank)
+        return;
+
+    float* percentileMem = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->percentileBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&percentileMem));
+    for (uint32_t s = 0; s < this->symbolCount; ++s)
+        memcpy(percentile + (size_t)s * this->timeCount, percentileMem + (size_t)s * this->rowStride, sizeof(float) * this->timeCount);
+    vkUnmapMemory(this->device, this->percentileBufferMemory);
+}
+
+// Creates everything a job needs on the device picked by options, from the job
+// fields already set on this. Fails, with everything released, when the device
+// cannot run the job. Timestamps are only recorded when the caller asked for stats.
+static int InitializeJob(ComputeApplication this, const ComputeOptions* options, bool timestamps, ComputeStats* timings)
+{
+    double start = ComputeTimestampMs();
+    this->deviceIndex = options->deviceIndex;
+    this->period = options->period != 0 ? options->period : SMA_DEFAULT_PERIOD;
+    this->workgroupSize = options->workgroupSize != 0 ? options->workgroupSize : DEFAULT_WORKGROUP_SIZE;
+    InitializeVulkanInstance(this);
+    double instanceCreated = ComputeTimestampMs();
+    SelectPhysicalDevice(this);
+    if (this->physicalDevice == VK_NULL_HANDLE || !IsSymbolCountSupported(this) ||
+        SelectStoragePrecision(this, options->storagePrecision) != 0)
+    {
+        vkDestroyInstance(this->instance, NULL);
+        free(this);
+        return 1;
+    }
+    SelectKernelVariant(this, options->kernelVariant);
+    InitializeVulkanDevice(this);
+    double deviceCreated = ComputeTimestampMs();
+    InitializeBuffers(this);
+    double allocated = ComputeTimestampMs();
+    InitializeDescriptorSetLayout(this);
+    InitializeDescriptorSets(this);
+    InitializePipelineCache(this);
+    if (!SelectWorkgroupSize(this, options->workgroupSize))
+    {
+        CleanUpVulkan(this);
+        free(this);
+        return 1;
+    }
+    InitializeComputePipelines(this);
+    if (timestamps)
+        InitializeTimestampQueries(this);
+    InitializeCommandBuffers(this);
+    double initialized = ComputeTimestampMs();
+    timings->instanceMs = instanceCreated - start;
+    timings->deviceMs = deviceCreated - instanceCreated;
+    timings->allocationMs = allocated - deviceCreated;
+    timings->pipelineMs = initialized - allocated;
+    timings->setupMs = initialized - start;
+    return 0;
+}
+
+// Reports the configuration the job ran with and releases it.
+static void FinishJob(ComputeApplication this, ComputeStats* timings, ComputeStats* stats)
+{
+    timings->storagePrecision = this->storagePrecision;
+    timings->kernelVariant = this->kernelVariant;
+    timings->workgroupSize = this->workgroupSize;
+    CleanUpVulkan(this);
+    free(this);
+    if (stats != NULL)
+        *stats = *timings;
+}
+
+// Runs a plain SMA job over symbol_count series of time_count candles, or a
+// timeframe job over a single series when timeframe_count is not zero.
+static int ComputeResultVulkan(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const uint32_t* timeframes, uint32_t timeframe_count,
+                               Candlestick* resampled, Indicator* output, float* percentile, const ComputeOptions* options, ComputeStats* stats)
+{
+    // Buffer sizes are 32 bit, so is every offset the shaders compute.
+    size_t rowStride = RowStride(symbol_count, time_count);
+    if (time_count > UINT32_MAX || (uint64_t)symbol_count * rowStride * sizeof(Indicator) > UINT32_MAX)
+        return 1;
+
+    ComputeStats timings = {0};
+    ComputeApplication app = (ComputeApplication) calloc(sizeof(struct ComputeApplication), 1);
+    if (app == NULL)
         return 1;
-    app = (ComputeApplication) calloc(sizeof(struct ComputeApplication), 1);
     app->inputData = (uint32_t*) kline;
-    app->inputBufferSize = kline_elements_count * sizeof(struct Candlestick);
-    app->inputDataElementsCount = kline_elements_count;
-    InitializeVulkanInstance(app);
-    SelectPhysicalDevice(app);
-    InitializeVulkanDevice(app);
-    InitializeBuffers(app);
-    InitializeDescriptorSetLayout(app);
-    InitializeDescriptorSets(app);
-    InitializeComputePipelines(app);
-    InitializeCommandBuffers(app);
-    void *mappedMemory = NULL;
-    VK_CHECK_RESULT(vkMapMemory(app->device, app->inputBufferMemory, 0, VK_WHOLE_SIZE, 0, &mappedMemory));
-    memcpy(mappedMemory, kline, sizeof(struct Candlestick) * kline_elements_count);
-    vkUnmapMemory(app->device, app->inputBufferMemory);
-    ExecuteComputeShaders(app);
-    Indicator* outputMem = NULL;
-    VK_CHECK_RESULT(vkMapMemory(app->device, app->outputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&outputMem));
-    memcpy(output, outputMem, sizeof(Indicator) * kline_elements_count);
-    vkUnmapMemory(app->device, app->outputBufferMemory);
-    CleanUpVulkan(app);
-    free(app);
+    app->symbolCount = symbol_count;
+    app->timeCount = (uint32_t)time_count;
+    app->rowStride = (uint32_t)rowStride;
+    app->inputDataElementsCount = symbol_count * (uint32_t)rowStride;
+    app->rank = percentile != NULL;
+    app->timeframeCount = timeframe_count;
+    for (uint32_t t = 0; t < timeframe_count; ++t)
+        app->timeframes[t] = timeframes[t];
+    if (InitializeJob(app, options, stats != NULL, &timings) != 0)
+        return 1;
+
+    double uploadStart = ComputeTimestampMs();
+    UploadRows(app, kline);
+    timings.uploadCopyMs = ComputeTimestampMs() - uploadStart;
+    timings.uploadMs = timings.uploadCopyMs;
+    if (app->timeframeCount > 0)
+        ExecuteJobCommandBuffer(app, &timings);
+    else
+        ExecuteComputeShaders(app, &timings);
+    double readbackStart = ComputeTimestampMs();
+    if (app->timeframeCount > 0)
+        ReadTimeframeResults(app, resampled, output);
+    else
+        ReadRows(app, output, percentile);
+    timings.readbackCopyMs = ComputeTimestampMs() - readbackStart;
+    timings.readbackMs += timings.readbackCopyMs;
+    FinishJob(app, &timings, stats);
+    return 0;
+}
+
+// Writes the returns of every symbol into the mapped staging buffer, one row per
+// symbol. Bar 0 has no previous close and gets 0, it only ever leaves a window.
+static void UploadReturns(ComputeApplication this, const Candlestick* kline)
+{
+    float* mappedMemory = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->inputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&mappedMemory));
+    for (uint32_t s = 0; s < this->symbolCount; ++s)
+    {
+        const Candlestick* series = kline + (size_t)s * this->timeCount;
+        float* row = mappedMemory + (size_t)s * this->rowStride;
+        row[0] = 0;
+        for (uint32_t t = 1; t < this->timeCount; ++t)
+            row[t] = series[t - 1].close != 0 ? (float)((double)series[t].close / series[t - 1].close - 1.0) : 0;
+    }
+    vkUnmapMemory(this->device, this->inputBufferMemory);
+}
+
+static void ReadCorrelations(ComputeApplication this, float* matrices, CorrelationPair* pairs, uint32_t* pair_count)
+{
+    char* outputMem = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->outputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&outputMem));
+    if (this->correlationPairs)
+    {
+        uint32_t found = *(const uint32_t*)outputMem;
+        uint32_t stored = found < this->pairCapacity ? found : this->pairCapacity;
+        memcpy(pairs, outputMem + CORRELATION_PAIRS_HEADER, stored * sizeof(CorrelationPair));
+        // The workgroups append their pairs in no particular order.
+        SortCorrelationPairs(pairs, stored);
+        *pair_count = found;
+    }
+    else
+        memcpy(matrices, outputMem, this->outputBufferSize);
+    vkUnmapMemory(this->device, this->outputBufferMemory);
+}
+
+static int ComputeCorrelationVulkan(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const CorrelationOptions* correlation,
+                                    float* matrices, CorrelationPair* pairs, uint32_t* pair_count, const ComputeOptions* options, ComputeStats* stats)
+{
+    size_t rowStride = RowStride(symbol_count, time_count);
+    uint32_t step = correlation->step != 0 ? correlation->step : 1;
+    size_t matrixCount = GetCorrelationMatrixCount(time_count, correlation->window, step);
+    uint64_t outputSize = matrices != NULL ? (uint64_t)matrixCount * symbol_count * symbol_count * sizeof(float)
+                                           : CORRELATION_PAIRS_HEADER + (uint64_t)*pair_count * sizeof(CorrelationPair);
+    if (time_count > UINT32_MAX || (uint64_t)symbol_count * rowStride * sizeof(float) > UINT32_MAX || outputSize > UINT32_MAX)
+        return 1;
+
+    ComputeStats timings = {0};
+    ComputeApplication app = (ComputeApplication) calloc(sizeof(struct ComputeApplication), 1);
+    if (app == NULL)
+        return 1;
+    app->symbolCount = symbol_count;
+    app->timeCount = (uint32_t)time_count;
+    app->rowStride = (uint32_t)rowStride;
+    app->inputDataElementsCount = symbol_count * (uint32_t)rowStride;
+    app->correlation = true;
+    app->correlationPairs = matrices == NULL;
+    app->correlationOptions = *correlation;
+    app->correlationOptions.step = step;
+    app->correlationMatrixCount = (uint32_t)matrixCount;
+    app->pairCapacity = matrices == NULL ? *pair_count : 0;
+    if (InitializeJob(app, options, stats != NULL, &timings) != 0)
+        return 1;
+
+    double uploadStart = ComputeTimestampMs();
+    UploadReturns(app, kline);
+    timings.uploadCopyMs = ComputeTimestampMs() - uploadStart;
+    timings.uploadMs = timings.uploadCopyMs;
+    ExecuteJobCommandBuffer(app, &timings);
+    double readbackStart = ComputeTimestampMs();
+    ReadCorrelations(app, matrices, pairs, pair_count);
+    timings.readbackCopyMs = ComputeTimestampMs() - readbackStart;
+    timings.readbackMs += timings.readbackCopyMs;
+    FinishJob(app, &timings, stats);
+    return 0;
+}
+
+int ComputeResultEx(const Candlestick* kline, size_t kline_elements_count, Indicator* output, const ComputeOptions* options, ComputeStats* stats)
+{
+    if (output == NULL || kline == NULL || kline_elements_count <= 0)
+        return 1;
+    ComputeOptions defaults = {0};
+    if (options == NULL)
+        options = &defaults;
+    if (options->backend != COMPUTE_BACKEND_VULKAN)
+        return ComputeResultCpu(kline, kline_elements_count, output, options, stats);
+    return ComputeResultVulkan(kline, 1, kline_elements_count, NULL, 0, NULL, output, NULL, options, stats);
+}
+
+int ComputeResampledResult(const Candlestick* kline, size_t kline_elements_count, const uint32_t* timeframes, uint32_t timeframe_count,
+                           Candlestick* resampled, Indicator* output, const ComputeOptions* options, ComputeStats* stats)
+{
+    if (output == NULL || kline == NULL || kline_elements_count <= 0 || timeframes == NULL ||
+        timeframe_count == 0 || timeframe_count > COMPUTE_MAX_TIMEFRAMES)
+        return 1;
+    for (uint32_t t = 0; t < timeframe_count; ++t)
+    {
+        if (timeframes[t] == 0)
+            return 1;
+    }
+    ComputeOptions defaults = {0};
+    if (options == NULL)
+        options = &defaults;
+    if (options->backend != COMPUTE_BACKEND_VULKAN)
+        return ComputeResampledResultCpu(kline, kline_elements_count, timeframes, timeframe_count, resampled, output, options, stats);
+    return ComputeResultVulkan(kline, 1, kline_elements_count, timeframes, timeframe_count, resampled, output, NULL, options, stats);
+}
+
+int ComputeCrossSectionalResult(const Candlestick* kline, uint32_t symbol_count, size_t time_count, Indicator* output, float* percentile,
+                                const ComputeOptions* options, ComputeStats* stats)
+{
+    if (output == NULL || kline == NULL || symbol_count == 0 || time_count == 0)
+        return 1;
+    ComputeOptions defaults = {0};
+    if (options == NULL)
+        options = &defaults;
+    if (options->backend != COMPUTE_BACKEND_VULKAN)
+        return ComputeCrossSectionalResultCpu(kline, symbol_count, time_count, output, percentile, options, stats);
+    return ComputeResultVulkan(kline, symbol_count, time_count, NULL, 0, NULL, output, percentile, options, stats);
+}
+
+int ComputeRollingCorrelation(const Candlestick* kline, uint32_t symbol_count, size_t time_count, const CorrelationOptions* correlation,
+                              float* matrices, CorrelationPair* pairs, uint32_t* pair_count, const ComputeOptions* options, ComputeStats* stats)
+{
+    // Exactly one of the outputs, and pairs may only be left out to count them.
+    if (kline == NULL || correlation == NULL || symbol_count == 0 || correlation->window < 2 ||
+        GetCorrelationMatrixCount(time_count, correlation->window, correlation->step) == 0 ||
+        (matrices == NULL) == (pair_count == NULL) || (pair_count != NULL && pairs == NULL && *pair_count > 0))
+        return 1;
+    ComputeOptions defaults = {0};
+    if (options == NULL)
+        options = &defaults;
+    if (options->backend != COMPUTE_BACKEND_VULKAN)
+        return ComputeRollingCorrelationCpu(kline, symbol_count, time_count, correlation, matrices, pairs, pair_count, options, stats);
+    return ComputeCorrelationVulkan(kline, symbol_count, time_count, correlation, matrices, pairs, pair_count, options, stats);
+}
+
+struct ComputeStream
+{
+    ComputeOptions options;
+    ComputeApplication vulkan; // NULL on the CPU backends
+    uint32_t period;
+    size_t chunkCapacity;
+    // The last candles pushed so far, up to STREAM_HALO(period) of them.
+    Candlestick* halo;
+    size_t haloCount;
+    // CPU backends only, the halo and the chunk back to back and their SMA.
+    Candlestick* candles;
+    Indicator* indicators;
+};
+
+// Writes the halo and the chunk after it into the mapped staging buffer.
+static void UploadStreamChunk(ComputeApplication this, const Candlestick* halo, size_t haloCount, const Candlestick* kline, size_t count)
+{
+    char* mappedMemory = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->inputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&mappedMemory));
+    char* chunk = mappedMemory + haloCount * CandleStorageSize(this);
+    if (this->storagePrecision == COMPUTE_PRECISION_FP16)
+    {
+        ConvertCandlesToHalf(halo, (uint16_t*)mappedMemory, haloCount);
+        ConvertCandlesToHalf(kline, (uint16_t*)chunk, count);
+    }
+    else
+    {
+        memcpy(mappedMemory, halo, sizeof(Candlestick) * haloCount);
+        memcpy(chunk, kline, sizeof(Candlestick) * count);
+    }
+    vkUnmapMemory(this->device, this->inputBufferMemory);
+}
+
+// Copies the SMA of the chunk, which follows that of the halo, out of the mapped result buffer.
+static void ReadStreamChunk(ComputeApplication this, size_t haloCount, Indicator* output, size_t count)
+{
+    char* outputMem = NULL;
+    VK_CHECK_RESULT(vkMapMemory(this->device, this->outputBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&outputMem));
+    const char* chunk = outputMem + haloCount * IndicatorStorageSize(this);
+    if (this->storagePrecision == COMPUTE_PRECISION_FP16)
+        ConvertHalfToIndicators((const uint16_t*)chunk, output, count);
+    else
+        memcpy(output, chunk, sizeof(Indicator) * count);
+    vkUnmapMemory(this->device, this->outputBufferMemory);
+}
+
+// The buffers hold a full chunk after a full halo, each push copies and dispatches
+// over its own halo and chunk only, see ResizeStreamJob.
+static int OpenStreamVulkan(ComputeStream* stream, ComputeStats* stats)
+{
+    size_t timeCount = STREAM_HALO(stream->period) + stream->chunkCapacity;
+    if ((uint64_t)timeCount * sizeof(Indicator) > UINT32_MAX)
+        return 1;
+
+    ComputeStats timings = {0};
+    ComputeApplication vulkan = (ComputeApplication) calloc(sizeof(struct ComputeApplication), 1);
+    if (vulkan == NULL)
+        return 1;
+    vulkan->symbolCount = 1;
+    vulkan->timeCount = (uint32_t)timeCount;
+    vulkan->rowStride = (uint32_t)timeCount;
+    vulkan->inputDataElementsCount = (uint32_t)timeCount;
+    vulkan->reusable = true;
+    if (InitializeJob(vulkan, &stream->options, true, &timings) != 0)
+        return 1;
+    stream->vulkan = vulkan;
+    if (stats != NULL)
+        *stats = timings;
+    return 0;
+}
+
+// Re-records the copies and both passes of a stream job for timeCount candles when the
+// last push covered a different number, so that a short push (the tail of a series,
+// a small file) costs its own candles rather than the capacity of the stream.
+static void ResizeStreamJob(ComputeApplication this, uint32_t timeCount)
+{
+    if (timeCount == this->timeCount)
+        return;
+    VkCommandBuffer commandBuffers[4] = {
+        this->copyInputBufferToDeviceCommand, this->smaPass1CommandBuffer, this->smaPass2CommandBuffer, this->copyFromDeviceOutputCommand
+    };
+    vkFreeCommandBuffers(this->device, this->commandPool, 4, commandBuffers);
+    this->timeCount = timeCount;
+    RecordCopyCommandBuffers(this, (VkDeviceSize)timeCount * CandleStorageSize(this), (VkDeviceSize)timeCount * IndicatorStorageSize(this));
+    RecordSmaCommandBuffers(this);
+}
+
+static void PushStreamVulkan(ComputeStream* stream, const Candlestick* kline, size_t count, Indicator* output, ComputeStats* stats)
+{
+    ComputeApplication vulkan = stream->vulkan;
+    ComputeStats timings = {0};
+    ResizeStreamJob(vulkan, (uint32_t)(stream->haloCount + count));
+    double uploadStart = ComputeTimestampMs();
+    UploadStreamChunk(vulkan, stream->halo, stream->haloCount, kline, count);
+    timings.uploadCopyMs = ComputeTimestampMs() - uploadStart;
+    timings.uploadMs = timings.uploadCopyMs;
+    ExecuteComputeShaders(vulkan, &timings);
+    double readbackStart = ComputeTimestampMs();
+    ReadStreamChunk(vulkan, stream->haloCount, output, count);
+    timings.readbackCopyMs = ComputeTimestampMs() - readbackStart;
+    timings.readbackMs += timings.readbackCopyMs;
+    timings.storagePrecision = vulkan->storagePrecision;
+    timings.kernelVariant = vulkan->kernelVariant;
+    timings.workgroupSize = vulkan->workgroupSize;
+    if (stats != NULL)
+        *stats = timings;
+}
+
+static int PushStreamCpu(ComputeStream* stream, const Candlestick* kline, size_t count, Indicator* output, ComputeStats* stats)
+{
+    memcpy(stream->candles, stream->halo, sizeof(Candlestick) * stream->haloCount);
+    memcpy(stream->candles + stream->haloCount, kline, sizeof(Candlestick) * count);
+    if (ComputeResultCpu(stream->candles, stream->haloCount + count, stream->indicators, &stream->options, stats) != 0)
+        return 1;
+    memcpy(output, stream->indicators + stream->haloCount, sizeof(Indicator) * count);
+    return 0;
+}
+
+int OpenComputeStream(size_t chunk_capacity, const ComputeOptions* options, ComputeStream** stream, ComputeStats* stats)
+{
+    if (stream == NULL || chunk_capacity == 0)
+        return 1;
+    ComputeStream* opened = (ComputeStream*)calloc(1, sizeof(ComputeStream));
+    if (opened == NULL)
+        return 1;
+    if (options != NULL)
+        opened->options = *options;
+    opened->period = opened->options.period != 0 ? opened->options.period : SMA_DEFAULT_PERIOD;
+    opened->options.period = opened->period;
+    opened->chunkCapacity = chunk_capacity;
+    size_t capacity = STREAM_HALO(opened->period) + chunk_capacity;
+    opened->halo = (Candlestick*)malloc(STREAM_HALO(opened->period) * sizeof(Candlestick));
+    bool cpu = opened->options.backend != COMPUTE_BACKEND_VULKAN;
+    if (cpu)
+    {
+        opened->candles = (Candlestick*)malloc(capacity * sizeof(Candlestick));
+        opened->indicators = (Indicator*)malloc(capacity * sizeof(Indicator));
+    }
+    if (opened->halo == NULL || (cpu && (opened->candles == NULL || opened->indicators == NULL)) ||
+        (!cpu && OpenStreamVulkan(opened, stats) != 0))
+    {
+        CloseComputeStream(opened);
+        return 1;
+    }
+    if (cpu && stats != NULL)
+        *stats = (ComputeStats){0};
+    *stream = opened;
     return 0;
-}
\ No newline at end of file
+}
+
+int PushComputeStream(ComputeStream* stream, const Candlestick* kline, size_t kline_elements_count, Indicator* output, ComputeStats* stats)
+{
+    if (stream == NULL || kline == NULL || output == NULL || kline_elements_count == 0 || kline_elements_count > stream->chunkCapacity)
+        return 1;
+    if (stream->vulkan != NULL)
+        PushStreamVulkan(stream, kline, kline_elements_count, output, stats);
+    else if (PushStreamCpu(stream, kline, kline_elements_count, output, stats) != 0)
+        return 1;
+
+    // The next halo is the tail of this halo followed by this chunk.
+    size_t haloCapacity = STREAM_HALO(stream->period);
+    if (kline_elements_count >= haloCapacity)
+    {
+        memcpy(stream->halo, kline + kline_elements_count - haloCapacity, sizeof(Candlestick) * haloCapacity);
+        stream->haloCount = haloCapacity;
+        return 0;
+    }
+    size_t kept = stream->haloCount + kline_elements_count > haloCapacity ? haloCapacity - kline_elements_count : stream->haloCount;
+    memmove(stream->halo, stream->halo + stream->haloCount - kept, sizeof(Candlestick) * kept);
+    memcpy(stream->halo + kept, kline, sizeof(Candlestick) * kline_elements_count);
+    stream->haloCount = kept + kline_elements_count;
+    return 0;
+}
+
+void ResetComputeStream(ComputeStream* stream)
+{
+    if (stream != NULL)
+        stream->haloCount = 0;
+}
+
+void CloseComputeStream(ComputeStream* stream)
+{
+    if (stream == NULL)
+        return;
+    if (stream->vulkan != NULL)
+    {
+        CleanUpVulkan(stream->vulkan);
+        free(stream->vulkan);
+    }
+    free(stream->indicators);
+    free(stream->candles);
+    free(stream->halo);
+    free(stream);
+}
+
+uint32_t GetComputeDeviceCount(void)
+{
+    struct ComputeApplication probe = {0};
+    VkApplicationInfo applicationInfo = (VkApplicationInfo){
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "Compute Sample",
+        .apiVersion = VK_API_VERSION_1_1
+    };
+    VkInstanceCreateInfo createInfo = (VkInstanceCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &applicationInfo
+    };
+    // Unlike InitializeVulkanInstance, a missing driver is not fatal here.
+    if (vkCreateInstance(&createInfo, NULL, &probe.instance) != VK_SUCCESS)
+        return 0;
+    uint32_t deviceCount = 0;
+    if (vkEnumeratePhysicalDevices(probe.instance, &deviceCount, NULL) != VK_SUCCESS)
+        deviceCount = 0;
+    vkDestroyInstance(probe.instance, NULL);
+    return deviceCount;
+}
+
+int GetComputeDeviceName(uint32_t index, char* name, size_t name_length)
+{
+    if (name == NULL || name_length == 0 || index >= GetComputeDeviceCount())
+        return 1;
+    struct ComputeApplication probe = { .deviceIndex = index };
+    InitializeVulkanInstance(&probe);
+    SelectPhysicalDevice(&probe);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(probe.physicalDevice, &properties);
+    snprintf(name, name_length, "%s", properties.deviceName);
+    vkDestroyInstance(probe.instance, NULL);
+    return 0;
+}
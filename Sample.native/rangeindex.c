@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "computesample.h"
+
+// Range queries over a raw Candlestick file. The index file holds a RangeIndexHeader,
+// then the prefix sums of the closes in doubles (count + 1 of them, the first one 0),
+// then the lowest low and the highest high of every block of blockSize candles. Both
+// files are mapped read only: a query reads the prefix sums around its window, the
+// block extremes it spans and the candles of its partial blocks, whatever the length
+// of the series. The index is rebuilt when the size or the modification time of the
+// candle file no longer match the ones it was built from.
+
+#define RANGE_INDEX_MAGIC 0x49525343u // "CSRI"
+#define RANGE_INDEX_VERSION 1u
+#define RANGE_INDEX_BUILD_CHUNK 65536
+
+typedef struct RangeIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint32_t blockSize;
+    uint32_t reserved;
+    uint64_t candleFileSize;
+    int64_t candleModifiedNs;
+} RangeIndexHeader;
+
+struct RangeIndex
+{
+    const Candlestick* candles;
+    size_t candleMapSize;
+    void* index;
+    size_t indexMapSize;
+    size_t count;
+    uint32_t blockSize;
+    const double* prefix;
+    const float* blockLow;
+    const float* blockHigh;
+};
+
+static size_t BlockCount(size_t count, uint32_t blockSize)
+{
+    return (count + blockSize - 1) / blockSize;
+}
+
+static size_t IndexFileSize(size_t count, uint32_t blockSize)
+{
+    return sizeof(RangeIndexHeader) + (count + 1) * sizeof(double) + 2 * BlockCount(count, blockSize) * sizeof(float);
+}
+
+static int64_t ModifiedNs(const struct stat* status)
+{
+    return (int64_t)status->st_mtim.tv_sec * 1000000000 + status->st_mtim.tv_nsec;
+}
+
+// Reads the candles sequentially and writes the index to a temporary file of its own,
+// renamed over index_path once complete, so concurrent builders and readers never see
+// half of it. Concurrent builders each rename a complete index, the last one stays.
+static int BuildRangeIndex(int candleFd, const struct stat* candleStatus, const char* index_path, uint32_t blockSize)
+{
+    size_t count = (size_t)candleStatus->st_size / sizeof(Candlestick);
+    size_t blocks = BlockCount(count, blockSize);
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.XXXXXX", index_path) >= (int)sizeof(temporary))
+        return 1;
+    Candlestick* chunk = (Candlestick*)malloc(RANGE_INDEX_BUILD_CHUNK * sizeof(Candlestick));
+    double* prefix = (double*)malloc(RANGE_INDEX_BUILD_CHUNK * sizeof(double));
+    float* extremes = (float*)malloc(2 * blocks * sizeof(float));
+    int fd = chunk != NULL && prefix != NULL && extremes != NULL ? mkostemp(temporary, O_CLOEXEC) : -1;
+    FILE* fp = fd >= 0 && fchmod(fd, 0644) == 0 ? fdopen(fd, "wb") : NULL;
+    if (fp == NULL)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temporary);
+        }
+        free(chunk);
+        free(prefix);
+        free(extremes);
+        return 1;
+    }
+
+    RangeIndexHeader header = {
+        .magic = RANGE_INDEX_MAGIC,
+        .version = RANGE_INDEX_VERSION,
+        .count = count,
+        .blockSize = blockSize,
+        .candleFileSize = (uint64_t)candleStatus->st_size,
+        .candleModifiedNs = ModifiedNs(candleStatus)
+    };
+    double sum = 0;
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(&sum, sizeof(sum), 1, fp) == 1;
+    float* blockLow = extremes;
+    float* blockHigh = extremes + blocks;
+    for (size_t offset = 0; offset < count && written; )
+    {
+        size_t length = count - offset < RANGE_INDEX_BUILD_CHUNK ? count - offset : RANGE_INDEX_BUILD_CHUNK;
+        if (pread(candleFd, chunk, length * sizeof(Candlestick), (off_t)(offset * sizeof(Candlestick))) != (ssize_t)(length * sizeof(Candlestick)))
+        {
+            written = false;
+            break;
+        }
+        for (size_t i = 0; i < length; ++i)
+        {
+            size_t x = offset + i;
+            size_t block = x / blockSize;
+            if (x % blockSize == 0)
+            {
+                blockLow[block] = chunk[i].low;
+                blockHigh[block] = chunk[i].high;
+            }
+            blockLow[block] = chunk[i].low < blockLow[block] ? chunk[i].low : blockLow[block];
+            blockHigh[block] = chunk[i].high > blockHigh[block] ? chunk[i].high : blockHigh[block];
+            sum += chunk[i].close;
+            prefix[i] = sum;
+        }
+        written = fwrite(prefix, sizeof(double), length, fp) == length;
+        offset += length;
+    }
+    written = written && fwrite(extremes, sizeof(float), 2 * blocks, fp) == 2 * blocks;
+    written = fclose(fp) == 0 && written;
+    free(chunk);
+    free(prefix);
+    free(extremes);
+    if (!written || rename(temporary, index_path) != 0)
+    {
+        unlink(temporary);
+        return 1;
+    }
+    return 0;
+}
+
+// Maps the index at path when it was built from the candle file as it is now.
+static void* MapRangeIndex(const char* path, const struct stat* candleStatus, uint32_t blockSize, size_t* mapSize)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    RangeIndexHeader header;
+    struct stat status;
+    void* mapped = NULL;
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && fstat(fd, &status) == 0 &&
+        header.magic == RANGE_INDEX_MAGIC && header.version == RANGE_INDEX_VERSION && header.blockSize > 0 &&
+        (blockSize == 0 || header.blockSize == blockSize) &&
+        header.candleFileSize == (uint64_t)candleStatus->st_size && header.candleModifiedNs == ModifiedNs(candleStatus) &&
+        header.count == (uint64_t)candleStatus->st_size / sizeof(Candlestick) &&
+        (uint64_t)status.st_size == IndexFileSize((size_t)header.count, header.blockSize))
+    {
+        mapped = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        mapped = mapped == MAP_FAILED ? NULL : mapped;
+        *mapSize = (size_t)status.st_size;
+    }
+    close(fd);
+    return mapped;
+}
+
+int OpenRangeIndex(const char* candle_path, const char* index_path, uint32_t block_size, RangeIndex** index)
+{
+    if (candle_path == NULL || index == NULL)
+        return 1;
+    char defaultPath[4096];
+    if (index_path == NULL)
+    {
+        if (snprintf(defaultPath, sizeof(defaultPath), "%s.idx", candle_path) >= (int)sizeof(defaultPath))
+            return 1;
+        index_path = defaultPath;
+    }
+    int candleFd = open(candle_path, O_RDONLY | O_CLOEXEC);
+    if (candleFd < 0)
+        return 1;
+    struct stat candleStatus;
+    RangeIndex* opened = (RangeIndex*)calloc(1, sizeof(RangeIndex));
+    if (opened == NULL || fstat(candleFd, &candleStatus) != 0 || candleStatus.st_size < (off_t)sizeof(Candlestick) ||
+        candleStatus.st_size % sizeof(Candlestick) != 0)
+    {
+        free(opened);
+        close(candleFd);
+        return 1;
+    }
+
+    opened->index = MapRangeIndex(index_path, &candleStatus, block_size, &opened->indexMapSize);
+    // A failed build may still find the index another builder renamed into place meanwhile.
+    if (opened->index == NULL)
+    {
+        BuildRangeIndex(candleFd, &candleStatus, index_path, block_size != 0 ? block_size : RANGE_INDEX_DEFAULT_BLOCK);
+        opened->index = MapRangeIndex(index_path, &candleStatus, block_size, &opened->indexMapSize);
+    }
+    opened->candleMapSize = (size_t)candleStatus.st_size;
+    void* candles = opened->index != NULL ? mmap(NULL, opened->candleMapSize, PROT_READ, MAP_SHARED, candleFd, 0) : MAP_FAILED;
+    close(candleFd);
+    if (candles == MAP_FAILED)
+    {
+        if (opened->index != NULL)
+            munmap(opened->index, opened->indexMapSize);
+        free(opened);
+        return 1;
+    }
+
+    // Queries jump to their window, reading ahead would only pull in pages they skip.
+    madvise(candles, opened->candleMapSize, MADV_RANDOM);
+    madvise(opened->index, opened->indexMapSize, MADV_RANDOM);
+    const RangeIndexHeader* header = (const RangeIndexHeader*)opened->index;
+    opened->candles = (const Candlestick*)candles;
+    opened->count = (size_t)header->count;
+    opened->blockSize = header->blockSize;
+    opened->prefix = (const double*)(header + 1);
+    opened->blockLow = (const float*)(opened->prefix + opened->count + 1);
+    opened->blockHigh = opened->blockLow + BlockCount(opened->count, opened->blockSize);
+    *index = opened;
+    return 0;
+}
+
+size_t GetRangeIndexCount(const RangeIndex* index)
+{
+    return index != NULL ? index->count : 0;
+}
+
+// Mean close of the period candles ending at x, the first SMA pass.
+static float WindowMean(const double* prefix, size_t x, uint32_t period)
+{
+    return (float)((prefix[x + 1] - prefix[x + 1 - period]) / period);
+}
+
+int QueryRangeSma(const RangeIndex* index, uint32_t period, size_t from, size_t to, float* output)
+{
+    if (index == NULL || output == NULL || from >= to || to > index->count)
+        return 1;
+    period = period != 0 ? period : SMA_DEFAULT_PERIOD;
+    // Same definition as SmaRangeScalar: 1 before the first full window, then the
+    // window mean minus the previous window mean over the period.
+    float previous = (from == 0 || from - 1 < period) ? 1 : WindowMean(index->prefix, from - 1, period);
+    for (size_t x = from; x < to; ++x)
+    {
+        if (x < period)
+        {
+            output[x - from] = 1;
+            continue;
+        }
+        float current = WindowMean(index->prefix, x, period);
+        output[x - from] = current - previous / period;
+        previous = current;
+    }
+    return 0;
+}
+
+int QueryRangeSummary(const RangeIndex* index, size_t from, size_t to, RangeSummary* summary)
+{
+    if (index == NULL || summary == NULL || from >= to || to > index->count)
+        return 1;
+    float low = index->candles[from].low;
+    float high = index->candles[from].high;
+    size_t x = from;
+    while (x < to)
+    {
+        // Whole blocks come from the index, the partial ones at both ends from the candles.
+        size_t block = x / index->blockSize;
+        if (x % index->blockSize == 0 && x + index->blockSize <= to)
+        {
+            low = index->blockLow[block] < low ? index->blockLow[block] : low;
+            high = index->blockHigh[block] > high ? index->blockHigh[block] : high;
+            x += index->blockSize;
+            continue;
+        }
+        size_t end = (block + 1) * index->blockSize < to ? (block + 1) * index->blockSize : to;
+        for (; x < end; ++x)
+        {
+            low = index->candles[x].low < low ? index->candles[x].low : low;
+            high = index->candles[x].high > high ? index->candles[x].high : high;
+        }
+    }
+    *summary = (RangeSummary){
+        .meanClose = (index->prefix[to] - index->prefix[from]) / (double)(to - from),
+        .low = low,
+        .high = high
+    };
+    return 0;
+}
+
+void CloseRangeIndex(RangeIndex* index)
+{
+    if (index == NULL)
+        return;
+    munmap((void*)index->candles, index->candleMapSize);
+    munmap(index->index, index->indexMapSize);
+    free(index);
+}
@@ -1,93 +1,190 @@
 using System.Diagnostics;
 using Microsoft.AspNetCore.Mvc;
+using System.ComponentModel.DataAnnotations;
+using Microsoft.AspNetCore.WebUtilities;
+using Microsoft.Net.Http.Headers;
 using Sample.Models;
-using CsvHelper;
-using System.Collections.Concurrent;
-using System.Security.Cryptography;
 
 namespace Sample.Controllers;
 
-public class DownloadItem {
-    public long ID {get;}
-    public byte[] Content {get;}
-
-    public DownloadItem(WorkItem item, byte[] content)
-    {
-        if (content is null)
-            throw new NullReferenceException($"{nameof(content)} cannot be null.");
-        ID = item.WorkItemIndex;
-        Content = content;
-    }
-}
-
 public class APIController : Controller
 {
+    /// <summary>
+    /// Indicators written by StreamingJob, part of the result cache key.
+    /// </summary>
+    private const string ResultIndicators = "sma";
+
+    /// <summary>
+    /// Optional request header with the hex SHA-256 of the candles, their PricePoint bytes in
+    /// order. When the job it names is cached the upload is only parsed and hashed.
+    /// </summary>
+    private const string CandlesHashHeader = "X-Candles-SHA256";
+
+    /// <summary>
+    /// Longest chart window Range answers in one request.
+    /// </summary>
+    private const long MaxRangeCandles = 100000;
+
     private readonly ILogger<HomeController> _logger;
     private readonly ISMAIndicatorProcessor _processor;
-    // This is not a recommended approach to storing download files, but for demonstrative purpose, this will do to simplify code.
-    protected static ConcurrentDictionary<long, DownloadItem> DownloadCache {get;} = new ConcurrentDictionary<long, DownloadItem>();
-    public APIController(ILogger<HomeController> logger, ISMAIndicatorProcessor processor)
+    private readonly ResultCache _resultCache;
+    private readonly SeriesIndexCache _series;
+    public APIController(ILogger<HomeController> logger, ISMAIndicatorProcessor processor, ResultCache resultCache, SeriesIndexCache series)
     {
         _logger = logger;
         _processor = processor;
-        _processor.CompletedWorkItem += (object? sender, WorkItem item) => {
-
-            using var memStream = new MemoryStream();
-            using var streamWriter = new StreamWriter(memStream);
-            using var writer = new CsvWriter(streamWriter, System.Globalization.CultureInfo.GetCultureInfo("en-US"));
-
-            var smaOutput = item.ComputedOutput[0].Select(I => new {SMA = I}).ToArray();
-            writer.WriteHeader(smaOutput.First().GetType());
-            writer.WriteRecords(smaOutput);
-            writer.Flush();
-            streamWriter.Flush();
-            memStream.Flush();
-            var downloadItem = new DownloadItem(item, memStream.GetBuffer());
-            DownloadCache.TryAdd(item.WorkItemIndex, downloadItem);
-        };
+        _resultCache = resultCache;
+        _series = series;
     }
 
+    /// <summary>
+    /// Reads the multipart form as it arrives instead of binding it, so that the candles are
+    /// parsed and computed chunk by chunk while the file is still being uploaded. Period and
+    /// HalfPrecision are needed before the first chunk, the form sends them ahead of File.
+    /// </summary>
     [HttpPost]
-    public async Task<IActionResult> SubmitJob(SubmitJobModel model)
+    public async Task<IActionResult> SubmitJob()
     {
-        if (!ModelState.IsValid) return StatusCode(400);
-        if (model.File is null || model.File.Length <= 0)
+        if (!MediaTypeHeaderValue.TryParse(Request.ContentType, out var contentType) ||
+            !"multipart/form-data".Equals(contentType.MediaType.Value, StringComparison.OrdinalIgnoreCase))
+            return StatusCode(400);
+        var boundary = HeaderUtilities.RemoveQuotes(contentType.Boundary).Value;
+        if (string.IsNullOrEmpty(boundary))
+            return StatusCode(400);
+
+        byte[]? claimedHash = null;
+        if (Request.Headers.TryGetValue(CandlesHashHeader, out var claimedHeader))
+        {
+            try { claimedHash = Convert.FromHexString(claimedHeader.ToString()); }
+            catch (FormatException) { return StatusCode(400); }
+            if (claimedHash.Length != 32)
+                return StatusCode(400);
+        }
+
+        var settings = new SubmitJobModel();
+        var seen = new HashSet<string>();
+        StreamingJob? job = null;
+        bool uploaded = false;
+        try
+        {
+            var reader = new MultipartReader(boundary, Request.Body);
+            MultipartSection? section;
+            while ((section = await reader.ReadNextSectionAsync(HttpContext.RequestAborted)) is not null)
+            {
+                if (!ContentDispositionHeaderValue.TryParse(section.ContentDisposition, out var disposition))
+                    continue;
+                var name = HeaderUtilities.RemoveQuotes(disposition.Name).Value;
+                if (disposition.IsFileDisposition())
+                {
+                    if (name != nameof(SubmitJobModel.File) || job is not null)
+                        continue;
+                    if (!Validator.TryValidateProperty(settings.Period, new ValidationContext(settings) { MemberName = nameof(SubmitJobModel.Period) }, null))
+                        return StatusCode(400);
+                    var precision = settings.HalfPrecision ? ComputePrecision.Fp16 : ComputePrecision.Fp32;
+                    bool cached = claimedHash is not null &&
+                                  _resultCache.Contains(ResultCache.FinishKey(claimedHash, ResultIndicators, settings.Period, precision));
+                    job = _processor.BeginStream(settings.Period, precision, compute: !cached);
+                    await job.ReadCsvAsync(section.Body, HttpContext.RequestAborted);
+                    continue;
+                }
+                if (name is null || !seen.Add(name))
+                    continue; // Like model binding, the first value of a field wins
+                using var valueReader = new StreamReader(section.Body);
+                var value = await valueReader.ReadToEndAsync(HttpContext.RequestAborted);
+                if (name == nameof(SubmitJobModel.Period))
+                {
+                    if (!uint.TryParse(value, out var period) || (job is not null && period != settings.Period))
+                        return StatusCode(400);
+                    settings.Period = period;
+                }
+                else if (name == nameof(SubmitJobModel.HalfPrecision))
+                {
+                    if (!bool.TryParse(value, out var halfPrecision) || (job is not null && halfPrecision != settings.HalfPrecision))
+                        return StatusCode(400);
+                    settings.HalfPrecision = halfPrecision;
+                }
+            }
+            if (job is null || job.CandleCount == 0)
+                return StatusCode(400);
+            uploaded = true;
+        }
+        finally
         {
+            // Invalid and interrupted uploads give their chunks back right away.
+            if (!uploaded)
+                job?.Abort();
+        }
+
+        var resultKey = job.FinishUpload(ResultIndicators);
+        if (claimedHash is not null && !claimedHash.AsSpan().SequenceEqual(job.CandlesHash))
+        {
+            job.Abort();
             return StatusCode(400);
         }
-        using var memStream = new MemoryStream();
-        await model.File.CopyToAsync(memStream);
-        memStream.Seek(0, SeekOrigin.Begin);
-        using var streamReader = new StreamReader(memStream);
-        using var reader = new CsvReader(streamReader, System.Globalization.CultureInfo.GetCultureInfo("en-US"));
-        var pricePoints = reader.GetRecords<PricePoint>();
-        var newWorkItem = new WorkItem(pricePoints.ToArray());
-        streamReader.Close();
-        _processor.EnqueueWork(newWorkItem);
-        return RedirectToAction("PendingJob","Home", new WorkItemModel { WorkItemID = newWorkItem.WorkItemIndex});
+        if (!job.Computes)
+        {
+            // Evicted while the candles were read, they are gone and have to be sent again.
+            if (!_resultCache.Contains(resultKey))
+                return StatusCode(StatusCodes.Status503ServiceUnavailable);
+        }
+        else if (_resultCache.Contains(resultKey))
+        {
+            // Same candles and parameters as an earlier job, its result is served as is. Without
+            // the hash header this is only known once the whole upload went through the device.
+            job.Abort();
+        }
+        return RedirectToAction("PendingJob","Home", new WorkItemModel { ResultKey = resultKey });
     }
 
     [HttpGet]
     public IActionResult CheckJob(WorkItemModel model)
     {
         if (!ModelState.IsValid || model is null) return NotFound();
-        if (!model.WorkItemID.HasValue)
+        if (!ResultCache.IsValidKey(model.ResultKey))
             return NotFound();
-        if (!DownloadCache.TryGetValue((model?.WorkItemID.Value ?? 0), out var downloadItem))
+        if (!_resultCache.Contains(model.ResultKey!))
         {
-            return NotFound();
+            return _resultCache.GetFailure(model.ResultKey!) switch {
+                ResultFailure.TooLarge => StatusCode(StatusCodes.Status507InsufficientStorage), // Computed, but too large to be kept
+                ResultFailure.ComputeFailed => StatusCode(StatusCodes.Status500InternalServerError),
+                _ => NotFound() // Still computing
+            };
         }
-        model.DownloadPath = $"/API/Download?id={downloadItem.ID}";
+        model.DownloadPath = $"/API/Download?key={model.ResultKey}";
         return Json(model);
     }
 
     [HttpGet]
-    public IActionResult Download(long id)
+    public IActionResult Download(string key)
     {
-        if (!ModelState.IsValid) return NotFound();
-        DownloadCache.TryGetValue(id, out var downloadItem);
-        if (downloadItem is null) return NotFound();
-        return File(downloadItem.Content, "text/csv", "Output.csv");
+        if (!ModelState.IsValid || !ResultCache.IsValidKey(key)) return NotFound();
+        if (!_resultCache.TryOpen(key, out var content)) return NotFound();
+        return File(content, "text/csv", "Output.csv");
+    }
+
+    /// <summary>
+    /// SMA, mean close and high-low of the candles [from, to) of a stored series, for a chart
+    /// window. Answered from the range index of the series, so the cost follows the window
+    /// and not the length of the history.
+    /// </summary>
+    [HttpGet]
+    public IActionResult Range(string series, long from, long to, uint period = LibComputeSample.DefaultPeriod)
+    {
+        if (!ModelState.IsValid || !SeriesIndexCache.IsValidName(series))
+            return NotFound();
+        if (period == 0 || period > SubmitJobModel.MaxPeriod || from < 0 || to <= from || to - from > MaxRangeCandles)
+            return StatusCode(400);
+        var index = _series.Get(series);
+        if (index is null)
+            return NotFound();
+        if (to > index.Count)
+            return StatusCode(400);
+        var sma = index.Sma(period, from, to);
+        var summary = index.Summary(from, to);
+        if (sma is null || summary is null)
+            return StatusCode(500);
+        return Json(new { series, from, to, period, count = index.Count, sma,
+                          meanClose = summary.Value.MeanClose, low = summary.Value.Low, high = summary.Value.High });
     }
 
     [ResponseCache(Duration = 0, Location = ResponseCacheLocation.None, NoStore = true)]
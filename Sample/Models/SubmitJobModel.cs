@@ -6,7 +6,16 @@ namespace Sample.Models;
 [BindProperties]
 public class SubmitJobModel
 {
+    public const uint MaxPeriod = 10000;
+
     [Required]
     [Display(Name="File")]
     public IFormFile? File {get;set;}
+
+    [Range(1, MaxPeriod)]
+    [Display(Name="SMA period")]
+    public uint Period {get;set;} = LibComputeSample.DefaultPeriod;
+
+    [Display(Name="Half precision storage")]
+    public bool HalfPrecision {get;set;}
 }
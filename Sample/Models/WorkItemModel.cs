@@ -5,6 +5,6 @@ namespace Sample.Models;
 [BindProperties]
 public class WorkItemModel
 {
-    public long? WorkItemID { get; set; }
+    public string? ResultKey { get; set; }
     public string? DownloadPath {get;set;}
 }
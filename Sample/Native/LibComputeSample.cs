@@ -1,26 +1,465 @@
 using System;
+using System.Collections.Concurrent;
 using System.Linq;
 using System.Runtime.InteropServices;
 namespace Sample;
 public static unsafe class LibComputeSample {
     /// <summary>
-    /// Compute a given workitem and returns Smooth Moving Average result.
+    /// The SMA period used when a job does not ask for another one.
     /// </summary>
-    public static float[]? Compute(WorkItem item)
+    public const uint DefaultPeriod = 14;
+
+    /// <summary>
+    /// Most timeframes a single ComputeTimeframes call accepts, mirrors COMPUTE_MAX_TIMEFRAMES.
+    /// </summary>
+    public const int MaxTimeframes = 8;
+
+    private static string? _daemonSocket;
+    private static readonly ConcurrentBag<IntPtr> _daemonConnections = new ConcurrentBag<IntPtr>();
+
+    /// <summary>
+    /// Where SmaStream runs, set once at startup by Configure. The other calls always run
+    /// in process.
+    /// </summary>
+    public static ComputeMode Mode {get; private set;} = ComputeMode.InProcess;
+
+    /// <summary>
+    /// Selects in process or daemon mode. In daemon mode the SMA jobs go to computesample-daemon,
+    /// which keeps the devices open across restarts of this process and whose driver faults
+    /// only fail the jobs in flight.
+    /// </summary>
+    public static void Configure(ComputeModeOptions options)
+    {
+        Mode = options.Mode;
+        _daemonSocket = string.IsNullOrEmpty(options.DaemonSocket) ? null : options.DaemonSocket;
+    }
+
+    // Daemon connections are used by one thread at a time, idle ones are kept for the next job.
+    // An idle connection whose daemon restarted meanwhile is closed rather than handed out.
+    private static IntPtr RentDaemonConnection()
+    {
+        while (_daemonConnections.TryTake(out var idle))
+        {
+            if (CheckComputeDaemon(idle) == 0)
+                return idle;
+            DisconnectComputeDaemon(idle);
+        }
+        IntPtr connection;
+        return ConnectComputeDaemon(_daemonSocket, &connection) == 0 ? connection : IntPtr.Zero;
+    }
+
+    // A connection whose job failed may have lost its daemon, the next job connects again.
+    private static void ReturnDaemonConnection(IntPtr connection, bool reusable)
+    {
+        if (reusable)
+            _daemonConnections.Add(connection);
+        else
+            DisconnectComputeDaemon(connection);
+    }
+
+    /// <summary>
+    /// SMA of a series that arrives in chunks, computed chunk by chunk on one device that
+    /// stays open in between. Each chunk gives the same SMA as a single job over the whole
+    /// series would for its candles, the candles needed from earlier chunks are kept natively.
+    /// Not thread safe, a stream is used by one thread at a time. In daemon mode the stream holds
+    /// a daemon connection and its device only opens with the first chunk, whose stats report the setup.
+    /// </summary>
+    public sealed class SmaStream : IDisposable
+    {
+        private IntPtr _stream;
+        private IntPtr _connection;
+        private ComputeOptions _options;
+        private bool _started;
+        private bool _failed;
+        private readonly Indicator[] _output;
+
+        private SmaStream(IntPtr stream, IntPtr connection, ComputeOptions options, int chunkCapacity)
+        {
+            _stream = stream;
+            _connection = connection;
+            _options = options;
+            _output = new Indicator[chunkCapacity];
+        }
+
+        /// <summary>
+        /// Opens a stream taking chunks of up to chunkCapacity candles, null when the device cannot run it.
+        /// </summary>
+        public static SmaStream? Open(int chunkCapacity, uint period, ComputePrecision precision, out ComputeStats stats)
+        {
+            stats = default;
+            var options = new ComputeOptions
+            {
+                backend = 0 /* Vulkan */,
+                period = period,
+                storagePrecision = (uint)precision
+            };
+            if (chunkCapacity <= 0)
+                return null;
+            if (Mode == ComputeMode.Daemon)
+            {
+                var connection = RentDaemonConnection();
+                return connection == IntPtr.Zero ? null : new SmaStream(IntPtr.Zero, connection, options, chunkCapacity);
+            }
+            IntPtr stream;
+            fixed (ComputeStats* statsPtr = &stats)
+            {
+                if (OpenComputeStream((nuint)chunkCapacity, &options, &stream, statsPtr) != 0)
+                    return null;
+            }
+            return new SmaStream(stream, IntPtr.Zero, options, chunkCapacity);
+        }
+
+        /// <summary>
+        /// Computes the SMA of the next chunk, the first count price points, into sma.
+        /// </summary>
+        public bool Push(PricePoint[] chunk, int count, float[] sma, out ComputeStats stats)
+        {
+            stats = default;
+            if ((_stream == IntPtr.Zero && _connection == IntPtr.Zero) || count <= 0 || count > _output.Length || count > chunk.Length || count > sma.Length)
+                return false;
+            int status;
+            fixed (ComputeStats* statsPtr = &stats)
+            fixed (Indicator* outPtr = _output)
+            fixed (PricePoint* ptr = chunk)
+            fixed (ComputeOptions* optionsPtr = &_options)
+            {
+                if (_stream != IntPtr.Zero)
+                    status = PushComputeStream(_stream, (Candlestick*)ptr, (nuint)count, outPtr, statsPtr);
+                else if (!_started)
+                    status = ComputeResultDaemon(_connection, (Candlestick*)ptr, (nuint)count, outPtr, optionsPtr, statsPtr);
+                else
+                    status = ContinueResultDaemon(_connection, (Candlestick*)ptr, (nuint)count, outPtr, statsPtr);
+            }
+            _started = true;
+            _failed |= status != 0;
+            if (status != 0)
+                return false;
+            for (int i = 0; i < count; ++i)
+                sma[i] = _output[i].sma;
+            return true;
+        }
+
+        public void Dispose()
+        {
+            if (_stream != IntPtr.Zero)
+                CloseComputeStream(_stream);
+            if (_connection != IntPtr.Zero)
+                ReturnDaemonConnection(_connection, !_failed);
+            _stream = IntPtr.Zero;
+            _connection = IntPtr.Zero;
+            GC.SuppressFinalize(this);
+        }
+
+        ~SmaStream() => Dispose();
+    }
+
+    /// <summary>
+    /// Range queries over a raw candle file, answered from an index of prefix sums and block
+    /// extremes kept next to it as <candle file>.idx, built on first use and whenever the candles
+    /// change. A query costs the length of its window, not of the series. Queries may run
+    /// concurrently; they use the files as they were when the index was opened.
+    /// </summary>
+    public sealed class RangeIndex : IDisposable
+    {
+        private IntPtr _index;
+
+        /// <summary>
+        /// Candles in the series.
+        /// </summary>
+        public long Count {get;}
+
+        private RangeIndex(IntPtr index)
+        {
+            _index = index;
+            Count = (long)GetRangeIndexCount(index);
+        }
+
+        /// <summary>
+        /// Opens the index of a candle file, building it first when needed. Null when the file
+        /// is missing or not a whole number of candles.
+        /// </summary>
+        public static RangeIndex? Open(string candlePath)
+        {
+            IntPtr index;
+            return OpenRangeIndex(candlePath, null, 0, &index) == 0 ? new RangeIndex(index) : null;
+        }
+
+        /// <summary>
+        /// The SMA Compute gives for the candles [from, to) of the whole series.
+        /// </summary>
+        public float[]? Sma(uint period, long from, long to)
+        {
+            if (from < 0 || to <= from || to > Count)
+                return null;
+            var sma = new float[to - from];
+            int status;
+            fixed (float* smaPtr = sma)
+                status = QueryRangeSma(_index, period, (nuint)from, (nuint)to, smaPtr);
+            GC.KeepAlive(this); // The finalizer must not unmap the files under the query
+            return status == 0 ? sma : null;
+        }
+
+        /// <summary>
+        /// Mean close, lowest low and highest high of the candles [from, to).
+        /// </summary>
+        public RangeSummary? Summary(long from, long to)
+        {
+            if (from < 0 || to <= from || to > Count)
+                return null;
+            RangeSummary summary;
+            int status = QueryRangeSummary(_index, (nuint)from, (nuint)to, &summary);
+            GC.KeepAlive(this);
+            return status == 0 ? summary : null;
+        }
+
+        public void Dispose()
+        {
+            if (_index == IntPtr.Zero)
+                return;
+            CloseRangeIndex(_index);
+            _index = IntPtr.Zero;
+            GC.SuppressFinalize(this);
+        }
+
+        ~RangeIndex() => Dispose();
+    }
+
+    /// <summary>
+    /// Resamples the price points into coarser timeframes on the device and returns the SMA
+    /// of each one, e.g. timeframes {5, 15, 60} turn 1 minute candles into 5m, 15m and 1h.
+    /// Every timeframe candle merges that many consecutive price points, counted from the first.
+    /// </summary>
+    public static float[][]? ComputeTimeframes(PricePoint[] points, uint period, ComputePrecision precision, uint[] timeframes, out ComputeStats stats)
+    {
+        stats = default;
+        if (points.Length == 0 || timeframes.Length == 0 || timeframes.Length > MaxTimeframes || timeframes.Any(T => T == 0))
+            return null;
+        var counts = timeframes.Select(T => (points.Length + (int)T - 1) / (int)T).ToArray();
+        var output = new Indicator[counts.Sum()];
+        var options = new ComputeOptions
+        {
+            backend = 0 /* Vulkan */,
+            period = period,
+            storagePrecision = (uint)precision
+        };
+        fixed (ComputeStats* statsPtr = &stats)
+        fixed (Indicator* outPtr = output)
+        fixed (PricePoint* ptr = points)
+        fixed (uint* timeframesPtr = timeframes)
+        {
+            if (ComputeResampledResult((Candlestick*)ptr, (nuint)points.Length, timeframesPtr, (uint)timeframes.Length,
+                                       null, outPtr, &options, statsPtr) != 0)
+                return null;
+        }
+        var results = new float[timeframes.Length][];
+        for (int t = 0, offset = 0; t < timeframes.Length; offset += counts[t++])
+            results[t] = output.Skip(offset).Take(counts[t]).Select(I => I.sma).ToArray();
+        return results;
+    }
+
+    /// <summary>
+    /// Computes the SMA of time aligned series of equal length, one per symbol, as a single
+    /// cross-sectional job, along with the percentile of every symbol's SMA among all symbols
+    /// at the same time. Ties share their percentile, a lone symbol sits at 0.5.
+    /// </summary>
+    public static float[][]? ComputeCrossSection(PricePoint[][] series, uint period, ComputePrecision precision,
+                                                 out float[][] percentiles, out ComputeStats stats)
     {
-        var output = new Indicator[item.PricePoints.Length];
+        stats = default;
+        percentiles = Array.Empty<float[]>();
+        if (series.Length == 0 || series[0].Length == 0 || series.Any(S => S.Length != series[0].Length))
+            return null;
+        int timeCount = series[0].Length;
+        var candles = ToMatrix(series);
+        var output = new Indicator[candles.Length];
+        var percentile = new float[candles.Length];
+        var options = new ComputeOptions
+        {
+            backend = 0 /* Vulkan */,
+            period = period,
+            storagePrecision = (uint)precision
+        };
+        fixed (ComputeStats* statsPtr = &stats)
         fixed (Indicator* outPtr = output)
-        fixed (PricePoint* ptr = item.PricePoints)
+        fixed (float* percentilePtr = percentile)
+        fixed (PricePoint* ptr = candles)
+        {
+            if (ComputeCrossSectionalResult((Candlestick*)ptr, (uint)series.Length, (nuint)timeCount, outPtr, percentilePtr, &options, statsPtr) != 0)
+                return null;
+        }
+        var results = new float[series.Length][];
+        percentiles = new float[series.Length][];
+        for (int s = 0; s < series.Length; ++s)
+        {
+            results[s] = output.Skip(s * timeCount).Take(timeCount).Select(I => I.sma).ToArray();
+            percentiles[s] = percentile.AsSpan(s * timeCount, timeCount).ToArray();
+        }
+        return results;
+    }
+
+    /// <summary>
+    /// Rolling correlation of the returns of time aligned series of equal length, one per symbol,
+    /// over windows of window bars ending on bars window, window + step, ... Returns one
+    /// symbol x symbol matrix per window, or population covariances when covariance is set.
+    /// </summary>
+    public static float[][,]? ComputeCorrelationMatrices(PricePoint[][] series, uint window, uint step, bool covariance, out ComputeStats stats)
+    {
+        stats = default;
+        if (series.Length == 0 || series.Any(S => S.Length != series[0].Length))
+            return null;
+        int symbols = series.Length;
+        var matrixCount = (long)GetCorrelationMatrixCount((nuint)series[0].Length, window, step);
+        // The device writes up to 4 GiB of matrices, any index into them fits an int.
+        long matrixElements = matrixCount * symbols * symbols;
+        if (matrixCount == 0 || matrixElements * sizeof(float) > uint.MaxValue)
+            return null;
+        var matrices = new float[matrixElements];
+        var correlation = new CorrelationOptions { window = window, step = step, covariance = covariance ? 1u : 0u };
+        var candles = ToMatrix(series);
+        fixed (ComputeStats* statsPtr = &stats)
+        fixed (float* matricesPtr = matrices)
+        fixed (PricePoint* ptr = candles)
+        {
+            var options = new ComputeOptions { backend = 0 /* Vulkan */ };
+            if (ComputeRollingCorrelation((Candlestick*)ptr, (uint)symbols, (nuint)series[0].Length, &correlation, matricesPtr, null, null, &options, statsPtr) != 0)
+                return null;
+        }
+        var results = new float[matrixCount][,];
+        for (long m = 0; m < matrixCount; ++m)
+        {
+            results[m] = new float[symbols, symbols];
+            // BlockCopy takes int byte offsets, which the matrices outgrow past 2 GiB.
+            matrices.AsSpan().Slice((int)(m * symbols * symbols), symbols * symbols).CopyTo(MemoryMarshal.CreateSpan(ref results[m][0, 0], symbols * symbols));
+        }
+        return results;
+    }
+
+    /// <summary>
+    /// The pairs of symbols whose rolling correlation, as in ComputeCorrelationMatrices, reaches
+    /// threshold in absolute value, sorted by time, first and second symbol.
+    /// </summary>
+    public static CorrelationPair[]? ComputeCorrelatedPairs(PricePoint[][] series, uint window, uint step, float threshold, out ComputeStats stats)
+    {
+        stats = default;
+        if (series.Length == 0 || series.Any(S => S.Length != series[0].Length))
+            return null;
+        var correlation = new CorrelationOptions { window = window, step = step, threshold = threshold };
+        var candles = ToMatrix(series);
+        // Guess a capacity and, when more pairs were found, run again with room for all of them.
+        var pairs = new CorrelationPair[4096];
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            uint count = (uint)pairs.Length;
+            fixed (ComputeStats* statsPtr = &stats)
+            fixed (CorrelationPair* pairsPtr = pairs)
+            fixed (PricePoint* ptr = candles)
+            {
+                var options = new ComputeOptions { backend = 0 /* Vulkan */ };
+                if (ComputeRollingCorrelation((Candlestick*)ptr, (uint)series.Length, (nuint)series[0].Length, &correlation, null, pairsPtr, &count, &options, statsPtr) != 0)
+                    return null;
+            }
+            if (count <= pairs.Length)
+                return pairs.Take((int)count).ToArray();
+            pairs = new CorrelationPair[count];
+        }
+        return null;
+    }
+
+    // The native cross-sectional calls take a single [symbol][time] matrix.
+    private static PricePoint[] ToMatrix(PricePoint[][] series)
+    {
+        int timeCount = series[0].Length;
+        var candles = new PricePoint[series.Length * timeCount];
+        for (int s = 0; s < series.Length; ++s)
+            series[s].CopyTo(candles, s * timeCount);
+        return candles;
+    }
+
+    /// <summary>
+    /// Backtests a long/short moving average crossover on the price points for every
+    /// (fast, slow) pair in one native call, spread over the CPU threads, and returns
+    /// one summary per pair in the same order. Pairs need 0 &lt; Fast &lt; Slow &lt; points.
+    /// </summary>
+    public static BacktestSummary[]? RunCrossoverSweep(PricePoint[] points, BacktestPair[] pairs, out ComputeStats stats)
+    {
+        stats = default;
+        if (pairs.Length == 0)
+            return null;
+        var summaries = new BacktestSummary[pairs.Length];
+        var options = new ComputeOptions(); // threadCount 0 uses every core
+        fixed (ComputeStats* statsPtr = &stats)
+        fixed (BacktestSummary* summariesPtr = summaries)
+        fixed (BacktestPair* pairsPtr = pairs)
+        fixed (PricePoint* ptr = points)
         {
-            if (ComputeResult((Candlestick*)ptr, (nuint)item.PricePoints.Length, outPtr) != 0)
-                return null; // Error occurs
-            return output.Select(I => I.sma).ToArray(); // Select only SMA for this.
+            if (RunCrossoverSweep((Candlestick*)ptr, (nuint)points.Length, pairsPtr, (uint)pairs.Length, summariesPtr, &options, statsPtr) != 0)
+                return null;
         }
+        return summaries;
     }
 
     [DllImport("computesample")]
     private static extern int ComputeResult(Candlestick* kline, nuint kline_elements_count, Indicator* output);
 
+    [DllImport("computesample")]
+    private static extern int OpenComputeStream(nuint chunk_capacity, ComputeOptions* options, IntPtr* stream, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern int PushComputeStream(IntPtr stream, Candlestick* kline, nuint kline_elements_count, Indicator* output, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern void CloseComputeStream(IntPtr stream);
+
+    [DllImport("computesample")]
+    private static extern int ConnectComputeDaemon(string? socket_path, IntPtr* daemon);
+
+    [DllImport("computesample")]
+    private static extern int CheckComputeDaemon(IntPtr daemon);
+
+    [DllImport("computesample")]
+    private static extern int ComputeResultDaemon(IntPtr daemon, Candlestick* kline, nuint kline_elements_count, Indicator* output,
+                                                  ComputeOptions* options, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern int ContinueResultDaemon(IntPtr daemon, Candlestick* kline, nuint kline_elements_count, Indicator* output, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern void DisconnectComputeDaemon(IntPtr daemon);
+
+    [DllImport("computesample")]
+    private static extern int OpenRangeIndex(string candle_path, string? index_path, uint block_size, IntPtr* index);
+
+    [DllImport("computesample")]
+    private static extern nuint GetRangeIndexCount(IntPtr index);
+
+    [DllImport("computesample")]
+    private static extern int QueryRangeSma(IntPtr index, uint period, nuint from, nuint to, float* output);
+
+    [DllImport("computesample")]
+    private static extern int QueryRangeSummary(IntPtr index, nuint from, nuint to, RangeSummary* summary);
+
+    [DllImport("computesample")]
+    private static extern void CloseRangeIndex(IntPtr index);
+
+    [DllImport("computesample")]
+    private static extern int ComputeResampledResult(Candlestick* kline, nuint kline_elements_count, uint* timeframes, uint timeframe_count,
+                                                     Candlestick* resampled, Indicator* output, ComputeOptions* options, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern int ComputeCrossSectionalResult(Candlestick* kline, uint symbol_count, nuint time_count, Indicator* output, float* percentile,
+                                                          ComputeOptions* options, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern nuint GetCorrelationMatrixCount(nuint time_count, uint window, uint step);
+
+    [DllImport("computesample")]
+    private static extern int ComputeRollingCorrelation(Candlestick* kline, uint symbol_count, nuint time_count, CorrelationOptions* correlation,
+                                                        float* matrices, CorrelationPair* pairs, uint* pair_count, ComputeOptions* options, ComputeStats* stats);
+
+    [DllImport("computesample")]
+    private static extern int RunCrossoverSweep(Candlestick* kline, nuint kline_elements_count, BacktestPair* pairs, uint pair_count,
+                                                BacktestSummary* summaries, ComputeOptions* options, ComputeStats* stats);
+
     [StructLayout(LayoutKind.Sequential)]
     private struct Candlestick
     {
@@ -38,4 +477,147 @@ public static unsafe class LibComputeSample {
         public float padding2;
         public float padding3;
     }
-}
\ No newline at end of file
+
+    [StructLayout(LayoutKind.Sequential)]
+    private struct ComputeOptions
+    {
+        public int backend;
+        public uint deviceIndex;
+        public uint period;
+        public uint threadCount;
+        public uint storagePrecision;
+        public uint kernelVariant;
+        public uint workgroupSize;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    private struct CorrelationOptions
+    {
+        public uint window;
+        public uint step;
+        public float threshold;
+        public uint covariance;
+    }
+
+    /// <summary>
+    /// Mirrors the native CorrelationPair, Time is the bar the window ends on.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct CorrelationPair
+    {
+        public uint First;
+        public uint Second;
+        public uint Time;
+        public float Correlation;
+    }
+
+    /// <summary>
+    /// Mirrors the native RangeSummary.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RangeSummary
+    {
+        public double MeanClose;
+        public float Low; // Lowest low
+        public float High; // Highest high
+    }
+
+    /// <summary>
+    /// Moving average periods of one crossover strategy, mirrors the native BacktestPair.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BacktestPair
+    {
+        public uint Fast;
+        public uint Slow;
+    }
+
+    /// <summary>
+    /// Mirrors the native BacktestSummary. Pnl and MaxDrawdown are sums of simple returns,
+    /// Sharpe is the per bar mean over the standard deviation, not annualized.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BacktestSummary
+    {
+        public double Pnl;
+        public double Sharpe;
+        public double MaxDrawdown;
+        public uint Trades;
+        public uint Bars;
+    }
+
+    /// <summary>
+    /// Mirrors the native ComputeStats, every timing is in milliseconds.
+    /// The Gpu fields are only meaningful when GpuTimestampsValid is non zero.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ComputeStats
+    {
+        public double SetupMs;
+        public double UploadMs;
+        public double ComputeMs;
+        public double ReadbackMs;
+
+        public double InstanceMs;
+        public double DeviceMs;
+        public double AllocationMs;
+        public double PipelineMs;
+        public double AutotuneMs;
+        public double UploadCopyMs;
+        public double ReadbackCopyMs;
+
+        public double GpuUploadMs;
+        public double GpuResampleMs; // Only set by ComputeTimeframes
+        public double GpuSmaPass1Ms;
+        public double GpuSmaPass2Ms;
+        public double GpuRankMs; // Only set by ComputeCrossSection
+        public double GpuCorrelationMs; // Only set by the correlation calls
+        public double GpuReadbackMs;
+        public uint GpuTimestampsValid;
+        public ComputePrecision StoragePrecision; // The precision actually used, FP16 falls back to FP32 when unsupported
+        public ComputeKernelVariant KernelVariant; // The first pass implementation picked for the device
+        public uint WorkgroupSize;
+    }
+}
+
+/// <summary>
+/// Storage format of the device buffers, arithmetic is always performed in 32 bit floats.
+/// </summary>
+public enum ComputePrecision : uint
+{
+    Fp32 = 0,
+    Fp16 = 1
+}
+
+/// <summary>
+/// Implementation of the first SMA pass, Auto picks the fastest one the device supports.
+/// </summary>
+public enum ComputeKernelVariant : uint
+{
+    Auto = 0,
+    Naive = 1,
+    Shared = 2,
+    Subgroup = 3
+}
+
+/// <summary>
+/// Where LibComputeSample runs the SMA jobs.
+/// </summary>
+public enum ComputeMode
+{
+    InProcess = 0,
+    Daemon = 1
+}
+
+/// <summary>
+/// Settings of the "Compute" section in appsettings.json.
+/// </summary>
+public class ComputeModeOptions
+{
+    public ComputeMode Mode {get;set;} = ComputeMode.InProcess;
+
+    /// <summary>
+    /// Socket computesample-daemon listens on, empty for $XDG_RUNTIME_DIR/computesample.sock.
+    /// </summary>
+    public string? DaemonSocket {get;set;}
+}
@@ -1,6 +1,16 @@
 namespace Sample;
 
 public interface ISMAIndicatorProcessor {
-    public event EventHandler<WorkItem> CompletedWorkItem;
-    public void EnqueueWork(WorkItem item);
+    /// <summary>
+    /// Raised once the key of a job is known, before the job can complete.
+    /// </summary>
+    public event EventHandler<StreamingJob> FinishedStreamingUpload;
+    /// <summary>
+    /// Raised when a job ends with its ResultPath, or without one when it failed.
+    /// </summary>
+    public event EventHandler<StreamingJob> CompletedStreamingJob;
+    /// <summary>
+    /// Starts a job reading an upload. Without compute the candles are only parsed and hashed.
+    /// </summary>
+    public StreamingJob BeginStream(uint period, ComputePrecision precision, bool compute = true);
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+using System;
+using System.Collections.Concurrent;
+
+namespace Sample {
+    /// <summary>
+    /// Settings of the "Streaming" section in appsettings.json.
+    /// </summary>
+    public class StreamingOptions {
+        /// <summary>
+        /// Candles parsed into each chunk before it is handed to the device.
+        /// </summary>
+        public int ChunkCandles {get;set;} = 64 * 1024;
+
+        /// <summary>
+        /// Parsed chunks an upload may get ahead of its computation before reading the body pauses.
+        /// </summary>
+        public int QueuedChunks {get;set;} = 4;
+
+        /// <summary>
+        /// Free chunks kept for later uploads, the others are left to the garbage collector.
+        /// </summary>
+        public int PooledChunks {get;set;} = 32;
+
+        /// <summary>
+        /// Uploads computed at the same time, each one keeps a device open while its chunks keep coming.
+        /// </summary>
+        public int MaxConcurrentStreams {get;set;} = 2;
+
+        /// <summary>
+        /// How long an upload may leave its queue empty before its device is closed and its slot
+        /// handed to another upload. The device is opened again with its next chunk.
+        /// </summary>
+        public int StreamIdleMilliseconds {get;set;} = 1000;
+    }
+
+    /// <summary>
+    /// Fixed size PricePoint chunks shared by the uploads. Chunks are allocated on the pinned
+    /// object heap, so the native calls read them in place without pinning or copying them.
+    /// </summary>
+    public class PricePointChunkPool {
+        private readonly ConcurrentBag<PricePoint[]> _free = new ConcurrentBag<PricePoint[]>();
+        private readonly int _pooledChunks;
+
+        public int ChunkLength {get;}
+
+        public PricePointChunkPool(StreamingOptions options)
+        {
+            ChunkLength = Math.Max(options.ChunkCandles, 1);
+            _pooledChunks = options.PooledChunks;
+        }
+
+        public PricePoint[] Rent() =>
+            _free.TryTake(out var chunk) ? chunk : GC.AllocateUninitializedArray<PricePoint>(ChunkLength, pinned: true);
+
+        public void Return(PricePoint[] chunk)
+        {
+            if (chunk.Length == ChunkLength && _free.Count < _pooledChunks)
+                _free.Add(chunk);
+        }
+    }
+}
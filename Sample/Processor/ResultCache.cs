@@ -0,0 +1,434 @@
+using System;
+using System.Diagnostics.Metrics;
+using System.IO.Compression;
+using System.Runtime.InteropServices;
+using System.Security.Cryptography;
+
+namespace Sample {
+    /// <summary>
+    /// Settings of the "ResultCache" section in appsettings.json.
+    /// </summary>
+    public class ResultCacheOptions {
+        /// <summary>
+        /// Total size of the results kept in memory, least recently used ones are spilled past it.
+        /// </summary>
+        public long MemoryBudgetBytes {get;set;} = 64L * 1024 * 1024;
+
+        /// <summary>
+        /// Total size of the compressed results kept on disk, 0 disables the spill.
+        /// </summary>
+        public long DiskBudgetBytes {get;set;} = 1024L * 1024 * 1024;
+
+        /// <summary>
+        /// Directory holding the spilled results, defaults to sample-results in the temp directory.
+        /// </summary>
+        public string? SpillDirectory {get;set;}
+    }
+
+    /// <summary>
+    /// Why the result of a key is not in the cache although its job ended.
+    /// </summary>
+    public enum ResultFailure {
+        TooLarge, // Computed, but it could not be kept, see ResultCache.Add
+        ComputeFailed
+    }
+
+    /// <summary>
+    /// Computed results keyed by a hash of their inputs, so that resubmitting the same
+    /// candles with the same parameters is served without running the compute again.
+    /// Results live in memory up to MemoryBudgetBytes, after which the least recently used
+    /// ones are gzipped to the spill directory, which is itself trimmed to DiskBudgetBytes.
+    /// Spilled results survive restarts.
+    /// </summary>
+    public class ResultCache {
+        private const string SpillExtension = ".csv.gz";
+        private const int MaxFailedKeys = 1024;
+
+        private static readonly Counter<long> LookupsCounter = SMAIndicatorProcessor.ComputeMeter.CreateCounter<long>("compute.cache.lookups", "{lookup}", "Result cache lookups, tagged by result (memory, disk or miss).");
+
+        private class Entry {
+            public string Key {get;}
+            public byte[]? Content {get;set;} // Null once the entry only lives on disk
+            public long DiskBytes {get;set;}
+            public LinkedListNode<Entry>? MemoryNode {get;set;}
+            public LinkedListNode<Entry>? DiskNode {get;set;}
+
+            public Entry(string key) => Key = key;
+        }
+
+        private readonly ResultCacheOptions _options;
+        private readonly string? _spillDirectory;
+        private readonly object _lock = new object();
+        private readonly Dictionary<string, Entry> _entries = new Dictionary<string, Entry>();
+        // Most recently used first
+        private readonly LinkedList<Entry> _memoryOrder = new LinkedList<Entry>();
+        private readonly LinkedList<Entry> _diskOrder = new LinkedList<Entry>();
+        private long _memoryBytes;
+        private long _diskBytes;
+        // Keys of the latest jobs that ended without a stored result, oldest first in _failureOrder.
+        private readonly Dictionary<string, ResultFailure> _failures = new Dictionary<string, ResultFailure>();
+        private readonly Queue<string> _failureOrder = new Queue<string>();
+
+        public ResultCache(ResultCacheOptions options)
+        {
+            _options = options;
+            if (options.DiskBudgetBytes <= 0)
+                return;
+            _spillDirectory = string.IsNullOrEmpty(options.SpillDirectory) ? Path.Combine(Path.GetTempPath(), "sample-results") : options.SpillDirectory;
+            Directory.CreateDirectory(_spillDirectory);
+            // Spills a previous run was still writing.
+            foreach (var file in new DirectoryInfo(_spillDirectory).GetFiles("*.tmp"))
+                TryDelete(file.FullName);
+
+            // Picks up the results spilled by a previous run, oldest first so the newest end up at the front.
+            foreach (var file in new DirectoryInfo(_spillDirectory).GetFiles("*" + SpillExtension).OrderBy(F => F.LastWriteTimeUtc))
+            {
+                var key = file.Name.Substring(0, file.Name.Length - SpillExtension.Length);
+                if (!IsValidKey(key))
+                    continue;
+                var entry = new Entry(key) { DiskBytes = file.Length };
+                entry.DiskNode = _diskOrder.AddFirst(entry);
+                _entries[key] = entry;
+                _diskBytes += file.Length;
+            }
+            TrimDisk();
+        }
+
+        /// <summary>
+        /// Hashes the candles together with everything that changes the output. The hash is
+        /// SHA-256 as it is hardware accelerated on current CPUs and already in the BCL.
+        /// </summary>
+        public static string ComputeKey(PricePoint[] pricePoints, string indicators, uint period, ComputePrecision precision) =>
+            FinishKey(SHA256.HashData(MemoryMarshal.AsBytes(pricePoints.AsSpan())), indicators, period, precision);
+
+        /// <summary>
+        /// Completes a key from the SHA-256 of the candles, their PricePoint bytes in order. The key
+        /// only depends on that hash and the parameters, so a client sending the hash ahead of the
+        /// candles lets its job be found in the cache before anything is computed.
+        /// </summary>
+        public static string FinishKey(ReadOnlySpan<byte> candlesHash, string indicators, uint period, ComputePrecision precision)
+        {
+            using var hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256);
+            hash.AppendData(candlesHash);
+            Span<byte> parameters = stackalloc byte[sizeof(uint) * 2];
+            BitConverter.TryWriteBytes(parameters, period);
+            BitConverter.TryWriteBytes(parameters.Slice(sizeof(uint)), (uint)precision);
+            hash.AppendData(parameters);
+            hash.AppendData(System.Text.Encoding.UTF8.GetBytes(indicators));
+            return Convert.ToHexString(hash.GetHashAndReset());
+        }
+
+        /// <summary>
+        /// Keys come back from query strings and name the spill files, anything else than a hash is rejected.
+        /// </summary>
+        public static bool IsValidKey(string? key) =>
+            key is not null && key.Length == SHA256.HashSizeInBytes * 2 && key.All(Uri.IsHexDigit);
+
+        public bool Contains(string key)
+        {
+            lock (_lock)
+                return _entries.ContainsKey(key);
+        }
+
+        /// <summary>
+        /// Why the latest job of key ended without a stored result, null when it did not. Storing the
+        /// key or ClearFailure forgets it.
+        /// </summary>
+        public ResultFailure? GetFailure(string key)
+        {
+            lock (_lock)
+                return _failures.TryGetValue(key, out var failure) ? failure : null;
+        }
+
+        /// <summary>
+        /// Records that the job of key failed, so that the page waiting for it stops.
+        /// </summary>
+        public void AddFailure(string key)
+        {
+            lock (_lock)
+                RecordFailure(key, ResultFailure.ComputeFailed);
+        }
+
+        /// <summary>
+        /// Forgets the failure of an earlier job of key, when a new one starts.
+        /// </summary>
+        public void ClearFailure(string key)
+        {
+            lock (_lock)
+                _failures.Remove(key);
+        }
+
+        /// <summary>
+        /// Stores a result. A result larger than MemoryBudgetBytes only fits on disk: without a
+        /// spill directory, or when it cannot be spilled, it is rejected rather than evicted right
+        /// away, and GetFailure tells its job so. Returns false when the result was rejected.
+        /// </summary>
+        public bool Add(string key, byte[] content)
+        {
+            List<Entry> spills;
+            lock (_lock)
+            {
+                if (_entries.TryGetValue(key, out var existing))
+                {
+                    Touch(existing);
+                    _failures.Remove(key);
+                    return true;
+                }
+                if (content.Length > _options.MemoryBudgetBytes && _spillDirectory is null)
+                {
+                    RecordFailure(key, ResultFailure.TooLarge);
+                    return false;
+                }
+                var entry = new Entry(key);
+                _entries[key] = entry;
+                _failures.Remove(key); // An earlier copy failed to be kept, this one is
+                StoreInMemory(entry, content);
+                spills = TrimMemory();
+            }
+            SpillAll(spills);
+            return Contains(key);
+        }
+
+        /// <summary>
+        /// Adds a result written to a file and takes the file over. A result within the memory budget
+        /// is loaded like the ones given to Add, a larger one is compressed straight into the spill
+        /// directory and never held in memory.
+        /// </summary>
+        public bool AddFile(string key, string path)
+        {
+            if (new FileInfo(path).Length <= _options.MemoryBudgetBytes)
+            {
+                var content = File.ReadAllBytes(path);
+                File.Delete(path);
+                return Add(key, content);
+            }
+            string? temporary = null;
+            if (_spillDirectory is not null && !Contains(key))
+            {
+                using (var file = File.OpenRead(path))
+                    temporary = WriteSpill(file);
+            }
+            File.Delete(path);
+            lock (_lock)
+            {
+                if (_entries.TryGetValue(key, out var existing))
+                {
+                    Touch(existing);
+                    if (temporary is not null)
+                        TryDelete(temporary);
+                    _failures.Remove(key);
+                    return true;
+                }
+                var entry = new Entry(key);
+                if (temporary is null || !CommitSpill(entry, temporary))
+                {
+                    RecordFailure(key, ResultFailure.TooLarge);
+                    return false;
+                }
+                _entries[key] = entry;
+                _failures.Remove(key);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Opens the result stored under key, from memory or decompressed from the spill directory as
+        /// it is read, so a spilled result is never loaded whole.
+        /// </summary>
+        public bool TryOpen(string key, out Stream content)
+        {
+            content = Stream.Null;
+            lock (_lock)
+            {
+                if (!_entries.TryGetValue(key, out var entry))
+                {
+                    LookupsCounter.Add(1, new KeyValuePair<string, object?>("result", "miss"));
+                    return false;
+                }
+                if (entry.Content is not null)
+                {
+                    Touch(entry);
+                    LookupsCounter.Add(1, new KeyValuePair<string, object?>("result", "memory"));
+                    content = new MemoryStream(entry.Content, false);
+                    return true;
+                }
+                _diskOrder.Remove(entry.DiskNode!);
+                _diskOrder.AddFirst(entry.DiskNode!);
+            }
+
+            var restored = OpenSpill(key);
+            if (restored is null)
+            {
+                lock (_lock)
+                {
+                    // The file disappeared underneath us
+                    if (_entries.TryGetValue(key, out var entry) && entry.Content is null)
+                    {
+                        RemoveFromDisk(entry);
+                        _entries.Remove(key);
+                    }
+                }
+                LookupsCounter.Add(1, new KeyValuePair<string, object?>("result", "miss"));
+                return false;
+            }
+            LookupsCounter.Add(1, new KeyValuePair<string, object?>("result", "disk"));
+            content = restored;
+            return true;
+        }
+
+        private void StoreInMemory(Entry entry, byte[] content)
+        {
+            entry.Content = content;
+            entry.MemoryNode = _memoryOrder.AddFirst(entry);
+            _memoryBytes += content.Length;
+        }
+
+        private void Touch(Entry entry)
+        {
+            if (entry.MemoryNode is null)
+                return;
+            _memoryOrder.Remove(entry.MemoryNode);
+            _memoryOrder.AddFirst(entry.MemoryNode);
+        }
+
+        // Returns the evicted entries to spill once the lock is released. They keep their content,
+        // and are still served from it, until they are on disk.
+        private List<Entry> TrimMemory()
+        {
+            var spills = new List<Entry>();
+            while (_memoryBytes > _options.MemoryBudgetBytes && _memoryOrder.Last is not null)
+            {
+                var entry = _memoryOrder.Last.Value;
+                _memoryOrder.RemoveLast();
+                entry.MemoryNode = null;
+                _memoryBytes -= entry.Content!.Length;
+                if (entry.DiskNode is null && _spillDirectory is not null)
+                {
+                    spills.Add(entry);
+                    continue;
+                }
+                entry.Content = null;
+                if (entry.DiskNode is null)
+                    _entries.Remove(entry.Key);
+            }
+            return spills;
+        }
+
+        private void SpillAll(List<Entry> spills)
+        {
+            foreach (var entry in spills)
+            {
+                var temporary = WriteSpill(new MemoryStream(entry.Content!, false));
+                lock (_lock)
+                {
+                    if (temporary is null || !CommitSpill(entry, temporary))
+                    {
+                        _entries.Remove(entry.Key);
+                        RecordFailure(entry.Key, ResultFailure.TooLarge);
+                    }
+                    entry.Content = null;
+                }
+            }
+        }
+
+        // Compresses content into a temporary file of the spill directory, outside the lock. Null when that failed.
+        private string? WriteSpill(Stream content)
+        {
+            var temporary = Path.Combine(_spillDirectory!, Path.GetRandomFileName() + ".tmp");
+            try
+            {
+                using (var file = File.Create(temporary))
+                using (var gzip = new GZipStream(file, CompressionLevel.Fastest))
+                    content.CopyTo(gzip);
+                return temporary;
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+            {
+                TryDelete(temporary);
+                return null;
+            }
+        }
+
+        // Renames a spill written by WriteSpill into place and accounts for it, under the lock so that
+        // the files stay in step with the bookkeeping. False when it failed or does not fit the disk budget.
+        private bool CommitSpill(Entry entry, string temporary)
+        {
+            var path = SpillPath(entry.Key);
+            try
+            {
+                File.Move(temporary, path, true);
+                entry.DiskBytes = new FileInfo(path).Length;
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+            {
+                TryDelete(temporary);
+                return false;
+            }
+            entry.DiskNode = _diskOrder.AddFirst(entry);
+            _diskBytes += entry.DiskBytes;
+            TrimDisk();
+            return entry.DiskNode is not null;
+        }
+
+        private Stream? OpenSpill(string key)
+        {
+            try
+            {
+                File.SetLastWriteTimeUtc(SpillPath(key), DateTime.UtcNow); // Keeps the LRU order across restarts
+                return new GZipStream(File.OpenRead(SpillPath(key)), CompressionMode.Decompress);
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+            {
+                return null;
+            }
+        }
+
+        private void TrimDisk()
+        {
+            while (_diskBytes > _options.DiskBudgetBytes && _diskOrder.Last is not null)
+            {
+                var entry = _diskOrder.Last.Value;
+                RemoveFromDisk(entry);
+                if (entry.Content is null)
+                    _entries.Remove(entry.Key);
+            }
+        }
+
+        private void RemoveFromDisk(Entry entry)
+        {
+            if (entry.DiskNode is null)
+                return;
+            _diskOrder.Remove(entry.DiskNode);
+            entry.DiskNode = null;
+            _diskBytes -= entry.DiskBytes;
+            TryDelete(SpillPath(entry.Key));
+        }
+
+        private static void TryDelete(string path)
+        {
+            try
+            {
+                File.Delete(path);
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+            {
+            }
+        }
+
+        // A key stored or cleared after its failure stays in _failureOrder until it is dequeued,
+        // which may forget a later failure of the same key a little early.
+        private void RecordFailure(string key, ResultFailure failure)
+        {
+            if (_failures.TryAdd(key, failure))
+            {
+                _failureOrder.Enqueue(key);
+                if (_failureOrder.Count > MaxFailedKeys)
+                    _failures.Remove(_failureOrder.Dequeue());
+            }
+            else
+                _failures[key] = failure;
+        }
+
+        private string SpillPath(string key) => Path.Combine(_spillDirectory!, key + SpillExtension);
+    }
+}
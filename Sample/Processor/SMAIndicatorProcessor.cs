@@ -1,57 +1,86 @@
 using System;
-using System.Collections.Concurrent;
+using System.Diagnostics.Metrics;
 using Sample;
 
 namespace Sample {
     public class SMAIndicatorProcessor : ISMAIndicatorProcessor {
         /// <summary>
-        /// Thread for processing a batch of price points for Vulkan Compute.
-        /// When working with P/Invoke, it is sometime better to create Thread manually than building Async code.
-        /// Plus for this demonstration, Vulkan Compute is currently designed for single thread use, so
-        /// It's better to have vulkan computation run on separate thread.
+        /// Name of the Meter publishing the compute metrics, scrape it with dotnet-counters
+        /// or an OpenTelemetry metrics exporter.
         /// </summary>
-        private Thread? WorkerThread {get;set;}
-        public ConcurrentQueue<WorkItem> WorkItemQueue {get;set;} = new ConcurrentQueue<WorkItem>();
-        public event EventHandler<WorkItem>? CompletedWorkItem;
+        public const string MeterName = "Sample.Compute";
 
-        public void EnqueueWork(WorkItem workitem)
+        internal static readonly Meter ComputeMeter = new Meter(MeterName, "1.0");
+        private static readonly Counter<long> JobsCounter = ComputeMeter.CreateCounter<long>("compute.jobs", "{job}", "Jobs processed, tagged by status.");
+        private static readonly Counter<long> CandlesCounter = ComputeMeter.CreateCounter<long>("compute.candles", "{candle}", "Candles processed successfully.");
+        private static readonly Histogram<double> JobDuration = ComputeMeter.CreateHistogram<double>("compute.job.duration", "ms", "End to end native compute time per job.");
+        private static readonly Histogram<double> StageDuration = ComputeMeter.CreateHistogram<double>("compute.stage.duration", "ms", "Time spent in each compute stage, tagged by stage and clock (host or gpu).");
+
+        public event EventHandler<StreamingJob>? FinishedStreamingUpload;
+        public event EventHandler<StreamingJob>? CompletedStreamingJob;
+
+        private readonly StreamingOptions _streamingOptions;
+        private readonly PricePointChunkPool _chunkPool;
+        // Each streaming job keeps its own device open while its chunks keep coming.
+        private readonly SemaphoreSlim _streams;
+
+        public SMAIndicatorProcessor() : this(new StreamingOptions())
         {
-            WorkItemQueue.Enqueue(workitem);
-            Start();
         }
 
-        protected virtual void Start()
+        public SMAIndicatorProcessor(StreamingOptions streamingOptions)
         {
-            if (WorkerThread is null)
-                WorkerThread = new Thread(WorkerThreadAction);
-            else if (WorkerThread.ThreadState == ThreadState.Running)
-                return;
-            else
-            {
-                WorkerThread.Join(); // Terminates the thread and then allow it to be garbage collected
-                WorkerThread = new Thread(WorkerThreadAction); // Assign new reference to create new thread going forward
-            }
-            WorkerThread.Start();
+            _streamingOptions = streamingOptions;
+            _chunkPool = new PricePointChunkPool(streamingOptions);
+            _streams = new SemaphoreSlim(Math.Max(streamingOptions.MaxConcurrentStreams, 1));
         }
 
-        protected virtual void WorkerThreadAction(object? obj) {
-            while (!WorkItemQueue.IsEmpty)
+        public StreamingJob BeginStream(uint period, ComputePrecision precision, bool compute = true) =>
+            new StreamingJob(_chunkPool, _streams, _streamingOptions.QueuedChunks, TimeSpan.FromMilliseconds(Math.Max(_streamingOptions.StreamIdleMilliseconds, 1)), period, precision, compute,
+                             job => FinishedStreamingUpload?.Invoke(this, job), job => CompletedStreamingJob?.Invoke(this, job));
+
+        internal static void RecordJob(bool succeeded, long candles, double milliseconds)
+        {
+            JobDuration.Record(milliseconds);
+            JobsCounter.Add(1, new KeyValuePair<string, object?>("status", succeeded ? "ok" : "failed"));
+            if (succeeded)
+                CandlesCounter.Add(candles);
+        }
+
+        internal static void RecordStages(LibComputeSample.ComputeStats stats)
+        {
+            var precision = stats.StoragePrecision == ComputePrecision.Fp16 ? "fp16" : "fp32";
+            // Streaming jobs only set up their device for the first chunk.
+            if (stats.SetupMs > 0)
             {
-                if (!WorkItemQueue.TryDequeue(out var item))
-                {
-                    continue;
-                }
-
-                var result = LibComputeSample.Compute(item);
-                if (result is null)
-                {
-                    CompletedWorkItem?.Invoke(this, item);
-                    return;
-                }
-                item.ComputedOutput = new float[1][];
-                item.ComputedOutput[0] = result;
-                CompletedWorkItem?.Invoke(this, item);
+                RecordStage("instance", "host", precision, stats.InstanceMs);
+                RecordStage("device", "host", precision, stats.DeviceMs);
+                RecordStage("allocation", "host", precision, stats.AllocationMs);
+                RecordStage("pipeline", "host", precision, stats.PipelineMs);
             }
+            if (stats.AutotuneMs > 0)
+                RecordStage("autotune", "host", precision, stats.AutotuneMs);
+            RecordStage("upload", "host", precision, stats.UploadMs);
+            RecordStage("upload.memcpy", "host", precision, stats.UploadCopyMs);
+            RecordStage("compute", "host", precision, stats.ComputeMs);
+            RecordStage("readback", "host", precision, stats.ReadbackMs);
+            RecordStage("readback.memcpy", "host", precision, stats.ReadbackCopyMs);
+            if (stats.GpuTimestampsValid == 0)
+                return;
+            RecordStage("upload", "gpu", precision, stats.GpuUploadMs);
+            RecordStage("sma.pass1", "gpu", precision, stats.GpuSmaPass1Ms);
+            RecordStage("sma.pass2", "gpu", precision, stats.GpuSmaPass2Ms);
+            if (stats.GpuRankMs > 0)
+                RecordStage("rank", "gpu", precision, stats.GpuRankMs);
+            RecordStage("readback", "gpu", precision, stats.GpuReadbackMs);
+        }
+
+        private static void RecordStage(string stage, string clock, string precision, double milliseconds)
+        {
+            StageDuration.Record(milliseconds,
+                new KeyValuePair<string, object?>("stage", stage),
+                new KeyValuePair<string, object?>("clock", clock),
+                new KeyValuePair<string, object?>("precision", precision));
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,78 @@
+using System;
+using System.Collections.Concurrent;
+
+namespace Sample {
+    /// <summary>
+    /// Settings of the "Series" section in appsettings.json.
+    /// </summary>
+    public class SeriesOptions {
+        /// <summary>
+        /// Directory holding the stored series, one raw candle file named &lt;series&gt;.dat each,
+        /// like sample.dat or the inputs of computesample-batch. Defaults to "series" in the
+        /// working directory. The range indexes are written next to them.
+        /// </summary>
+        public string? Directory {get;set;}
+    }
+
+    /// <summary>
+    /// Open range indexes of the stored series, shared by the chart window requests. Each version
+    /// of a series file is opened once, by the first request for it, while the others wait for it.
+    /// A series whose file changed is opened again, which rebuilds its index; the previous index is
+    /// left to the garbage collector since requests in flight may still be querying it.
+    /// </summary>
+    public class SeriesIndexCache {
+        private record struct Version(string Name, long Length, DateTime LastWriteTimeUtc);
+
+        private const string SeriesExtension = ".dat";
+        private const int MaxNameLength = 64;
+
+        private readonly string _directory;
+        private readonly ConcurrentDictionary<Version, Lazy<LibComputeSample.RangeIndex?>> _indexes =
+            new ConcurrentDictionary<Version, Lazy<LibComputeSample.RangeIndex?>>();
+
+        public SeriesIndexCache(SeriesOptions options)
+        {
+            _directory = Path.GetFullPath(string.IsNullOrEmpty(options.Directory) ? "series" : options.Directory);
+            System.IO.Directory.CreateDirectory(_directory);
+        }
+
+        /// <summary>
+        /// Series names are file names, only letters, digits, '-' and '_' keep them inside the directory.
+        /// </summary>
+        public static bool IsValidName(string? name) =>
+            !string.IsNullOrEmpty(name) && name.Length <= MaxNameLength && name.All(C => char.IsAsciiLetterOrDigit(C) || C == '-' || C == '_');
+
+        /// <summary>
+        /// The index of a stored series, null when there is no such series or its file is not
+        /// a whole number of candles.
+        /// </summary>
+        public LibComputeSample.RangeIndex? Get(string name)
+        {
+            if (!IsValidName(name))
+                return null;
+            var file = new FileInfo(Path.Combine(_directory, name + SeriesExtension));
+            if (!file.Exists)
+            {
+                DropOtherVersions(new Version(name, -1, default));
+                return null;
+            }
+            var version = new Version(name, file.Length, file.LastWriteTimeUtc);
+            var lazy = _indexes.GetOrAdd(version, V => new Lazy<LibComputeSample.RangeIndex?>(() => LibComputeSample.RangeIndex.Open(file.FullName)));
+            var index = lazy.Value;
+            if (index is null)
+                _indexes.TryRemove(new KeyValuePair<Version, Lazy<LibComputeSample.RangeIndex?>>(version, lazy)); // The next request tries again
+            else
+                DropOtherVersions(version);
+            return index;
+        }
+
+        private void DropOtherVersions(Version current)
+        {
+            foreach (var version in _indexes.Keys)
+            {
+                if (version.Name == current.Name && version != current)
+                    _indexes.TryRemove(version, out _);
+            }
+        }
+    }
+}
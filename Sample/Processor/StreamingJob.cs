@@ -0,0 +1,362 @@
+using System;
+using System.Globalization;
+using System.Runtime.InteropServices;
+using System.Security.Cryptography;
+using System.Threading.Channels;
+using CsvHelper;
+
+namespace Sample {
+    /// <summary>
+    /// An SMA job computed while its candles are still being uploaded. ReadCsvAsync parses the
+    /// upload into pooled chunks and queues each one as soon as it is full; a consumer pushes
+    /// them through a native SMA stream and appends their SMA to a CSV result file. The queue is
+    /// bounded and the result goes to disk, so a job holds a few chunks at a time whatever the
+    /// size of the upload, and the result is ready shortly after the last chunk arrives. The
+    /// stream takes one of the MaxConcurrentStreams slots from its first chunk on and gives it
+    /// back whenever the upload stalls for StreamIdleMilliseconds.
+    /// </summary>
+    public class StreamingJob {
+        private readonly PricePointChunkPool _pool;
+        private readonly SemaphoreSlim _streams;
+        private readonly Action<StreamingJob> _uploadFinished;
+        private readonly Action<StreamingJob> _completed;
+        // Guards ResultKey against _ended, a job that fails before its upload finished is reported by FinishUpload.
+        private readonly object _reportLock = new object();
+        private bool _ended;
+        private readonly Channel<(PricePoint[] Chunk, int Count)> _chunks;
+        private readonly IncrementalHash _hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256);
+        private readonly CancellationTokenSource _abort = new CancellationTokenSource();
+        private readonly TimeSpan _idleTimeout;
+        private readonly bool _compute;
+        // The last candles computed, see KeepHalo.
+        private readonly PricePoint[] _halo;
+        private int _haloCount;
+
+        /// <summary>
+        /// Number of candles averaged by the SMA.
+        /// </summary>
+        public uint Period {get;}
+
+        /// <summary>
+        /// Requested storage format for the device buffers.
+        /// </summary>
+        public ComputePrecision StoragePrecision {get;}
+
+        /// <summary>
+        /// Candles read so far.
+        /// </summary>
+        public long CandleCount {get; private set;}
+
+        /// <summary>
+        /// ResultCache key of the output, known once the upload is finished.
+        /// </summary>
+        public string? ResultKey {get; private set;}
+
+        /// <summary>
+        /// False for a job that only reads and hashes the candles.
+        /// </summary>
+        public bool Computes => _compute;
+
+        /// <summary>
+        /// SHA-256 of the candles read, known once the upload is finished, see ResultCache.FinishKey.
+        /// </summary>
+        public byte[]? CandlesHash {get; private set;}
+
+        /// <summary>
+        /// Temporary file holding the CSV of the SMA of the whole series, null until the job
+        /// completes and when it failed. The completion handler takes the file over, see
+        /// ResultCache.AddFile. Failed jobs are reported to it too, once their ResultKey is known.
+        /// </summary>
+        public string? ResultPath {get; private set;}
+
+        /// <summary>
+        /// Completes once every chunk went through the device, or the job failed or was aborted.
+        /// </summary>
+        public Task Completion {get;}
+
+        // A job that does not compute only reads and hashes the candles, for an upload whose result
+        // is expected to be cached already. It never completes with a result nor a failure.
+        internal StreamingJob(PricePointChunkPool pool, SemaphoreSlim streams, int queuedChunks, TimeSpan idleTimeout, uint period,
+                              ComputePrecision precision, bool compute, Action<StreamingJob> uploadFinished, Action<StreamingJob> completed)
+        {
+            _pool = pool;
+            _streams = streams;
+            _idleTimeout = idleTimeout;
+            _compute = compute;
+            _halo = new PricePoint[period + 1];
+            _uploadFinished = uploadFinished;
+            _completed = completed;
+            _chunks = Channel.CreateBounded<(PricePoint[], int)>(new BoundedChannelOptions(Math.Max(queuedChunks, 1)) { SingleReader = true, SingleWriter = true });
+            Period = period;
+            StoragePrecision = precision;
+            Completion = Task.Run(ConsumeAsync);
+        }
+
+        /// <summary>
+        /// Parses a CSV with High, Low, Open and Close columns as it arrives and queues it chunk
+        /// by chunk, waiting whenever the computation falls QueuedChunks behind.
+        /// </summary>
+        public async Task ReadCsvAsync(Stream csv, CancellationToken cancellationToken)
+        {
+            using var streamReader = new StreamReader(csv);
+            using var reader = new CsvReader(streamReader, CultureInfo.GetCultureInfo("en-US"));
+            var chunk = _pool.Rent();
+            int count = 0;
+            try
+            {
+                await foreach (var pricePoint in reader.GetRecordsAsync<PricePoint>(cancellationToken))
+                {
+                    chunk[count++] = pricePoint;
+                    if (count < chunk.Length)
+                        continue;
+                    await WriteChunkAsync(chunk, count, cancellationToken);
+                    chunk = _pool.Rent();
+                    count = 0;
+                }
+                if (count > 0)
+                    await WriteChunkAsync(chunk, count, cancellationToken);
+                else
+                    _pool.Return(chunk);
+            }
+            catch
+            {
+                _pool.Return(chunk);
+                throw;
+            }
+        }
+
+        /// <summary>
+        /// Ends the upload and returns the result key, the same one ResultCache.ComputeKey gives for
+        /// all the candles. The upload handler runs before the job can complete, which it does once
+        /// the queued chunks are computed.
+        /// </summary>
+        public string FinishUpload(string indicators)
+        {
+            var candlesHash = _hash.GetHashAndReset();
+            var key = ResultCache.FinishKey(candlesHash, indicators, Period, StoragePrecision);
+            _hash.Dispose();
+            bool ended;
+            lock (_reportLock)
+            {
+                CandlesHash = candlesHash;
+                ResultKey = key;
+                ended = _ended;
+            }
+            _uploadFinished(this);
+            _chunks.Writer.TryComplete();
+            if (ended)
+                _completed(this);
+            return key;
+        }
+
+        /// <summary>
+        /// Drops the job, e.g. when the upload failed or its result is already cached.
+        /// </summary>
+        public void Abort()
+        {
+            _abort.Cancel();
+            _hash.Dispose();
+            _chunks.Writer.TryComplete();
+        }
+
+        private async ValueTask WriteChunkAsync(PricePoint[] chunk, int count, CancellationToken cancellationToken)
+        {
+            // Hashed in upload order, like ComputeKey hashes the whole array.
+            _hash.AppendData(MemoryMarshal.AsBytes(chunk.AsSpan(0, count)));
+            CandleCount += count;
+            await _chunks.Writer.WriteAsync((chunk, count), cancellationToken);
+        }
+
+        private async Task ConsumeAsync()
+        {
+            if (!_compute)
+            {
+                try
+                {
+                    await foreach (var (chunk, _) in _chunks.Reader.ReadAllAsync(_abort.Token))
+                        _pool.Return(chunk);
+                }
+                catch (OperationCanceledException)
+                {
+                    DrainChunks();
+                }
+                return;
+            }
+            // Only the native calls count towards the job duration, not the wait for the upload.
+            double nativeMs = 0;
+            bool failed = false;
+            long computed = 0;
+            string? resultPath = null;
+            LibComputeSample.SmaStream? stream = null;
+            LibComputeSample.ComputeStats setupStats = default;
+            bool holdsStream = false;
+            try
+            {
+                var sma = new float[_pool.ChunkLength];
+                resultPath = Path.Combine(Path.GetTempPath(), Path.GetRandomFileName());
+                using (var streamWriter = new StreamWriter(new FileStream(resultPath, FileMode.CreateNew, FileAccess.Write)))
+                using (var writer = new CsvWriter(streamWriter, CultureInfo.GetCultureInfo("en-US")))
+                {
+                    while (true)
+                    {
+                        // A device is only held while chunks keep coming. An upload that stalls for
+                        // the idle timeout gives it to the other jobs until its next chunk arrives.
+                        using (var idle = CancellationTokenSource.CreateLinkedTokenSource(_abort.Token))
+                        {
+                            if (holdsStream)
+                                idle.CancelAfter(_idleTimeout);
+                            try
+                            {
+                                if (!await _chunks.Reader.WaitToReadAsync(idle.Token))
+                                    break;
+                            }
+                            catch (OperationCanceledException) when (!_abort.IsCancellationRequested)
+                            {
+                                ReleaseStream();
+                                continue;
+                            }
+                        }
+                        if (!_chunks.Reader.TryRead(out var queued))
+                            continue;
+                        var (chunk, count) = queued;
+
+                        // A failed job still takes the chunks, so that the upload runs to its end.
+                        LibComputeSample.ComputeStats stats = default;
+                        if (!failed && !holdsStream)
+                        {
+                            await _streams.WaitAsync(_abort.Token);
+                            holdsStream = true;
+                            var startTimestamp = System.Diagnostics.Stopwatch.GetTimestamp();
+                            stream = OpenStream(sma, out setupStats);
+                            nativeMs += System.Diagnostics.Stopwatch.GetElapsedTime(startTimestamp).TotalMilliseconds;
+                            failed = stream is null;
+                        }
+                        if (!failed)
+                        {
+                            var startTimestamp = System.Diagnostics.Stopwatch.GetTimestamp();
+                            failed = !stream!.Push(chunk, count, sma, out stats);
+                            nativeMs += System.Diagnostics.Stopwatch.GetElapsedTime(startTimestamp).TotalMilliseconds;
+                        }
+                        if (!failed)
+                            KeepHalo(chunk, count);
+                        _pool.Return(chunk);
+                        if (failed)
+                        {
+                            // Nothing more goes through the device, the other jobs get it.
+                            if (holdsStream)
+                                ReleaseStream();
+                            continue;
+                        }
+                        // Each opening of the device is reported with the first chunk it computed.
+                        AddSetup(ref stats, setupStats);
+                        setupStats = default;
+                        SMAIndicatorProcessor.RecordStages(stats);
+                        computed += count;
+                        writer.WriteRecords(sma.Take(count).Select(I => new {SMA = I}));
+                    }
+                }
+                if (failed || computed == 0)
+                {
+                    SMAIndicatorProcessor.RecordJob(false, 0, nativeMs);
+                    ReportFailure();
+                    return;
+                }
+                ResultPath = resultPath;
+                SMAIndicatorProcessor.RecordJob(true, computed, nativeMs);
+                _completed(this);
+            }
+            catch (OperationCanceledException)
+            {
+                DrainChunks();
+            }
+            catch (Exception ex)
+            {
+                // Fails the pending writes instead of leaving the upload waiting on a full queue.
+                _chunks.Writer.TryComplete(ex);
+                DrainChunks();
+                SMAIndicatorProcessor.RecordJob(false, 0, nativeMs);
+                ReportFailure();
+            }
+            finally
+            {
+                if (holdsStream)
+                    ReleaseStream();
+                // Jobs without a result leave no file behind.
+                if (resultPath is not null && ResultPath is null)
+                    File.Delete(resultPath);
+            }
+
+            void ReleaseStream()
+            {
+                stream?.Dispose();
+                stream = null;
+                holdsStream = false;
+                _streams.Release();
+            }
+        }
+
+        // Opens a stream and, when it replaces one closed while the upload was idle, pushes the
+        // halo kept from the last chunks again so that the next chunk is computed as if the
+        // stream had stayed open. The SMA of the halo itself is dropped. Null when that failed.
+        private LibComputeSample.SmaStream? OpenStream(float[] sma, out LibComputeSample.ComputeStats setupStats)
+        {
+            var stream = LibComputeSample.SmaStream.Open(_pool.ChunkLength, Period, StoragePrecision, out setupStats);
+            for (int offset = 0; stream is not null && offset < _haloCount; offset += _pool.ChunkLength)
+            {
+                int count = Math.Min(_haloCount - offset, _pool.ChunkLength);
+                if (!stream.Push(offset == 0 ? _halo : _halo[offset..(offset + count)], count, sma, out _))
+                {
+                    stream.Dispose();
+                    return null;
+                }
+            }
+            return stream;
+        }
+
+        // Keeps the last STREAM_HALO(period) = period + 1 candles computed, as the native stream does.
+        private void KeepHalo(PricePoint[] chunk, int count)
+        {
+            if (count >= _halo.Length)
+            {
+                Array.Copy(chunk, count - _halo.Length, _halo, 0, _halo.Length);
+                _haloCount = _halo.Length;
+                return;
+            }
+            int kept = Math.Min(_haloCount, _halo.Length - count);
+            Array.Copy(_halo, _haloCount - kept, _halo, 0, kept);
+            Array.Copy(chunk, 0, _halo, kept, count);
+            _haloCount = kept + count;
+        }
+
+        // Hands a failed job to the completion handler, now when its key is known and otherwise
+        // from FinishUpload. A job whose upload fails as well never gets a key and is not reported.
+        private void ReportFailure()
+        {
+            lock (_reportLock)
+            {
+                _ended = true;
+                if (ResultKey is null)
+                    return;
+            }
+            _completed(this);
+        }
+
+        // Gives the chunks of an aborted job back to the pool.
+        private void DrainChunks()
+        {
+            while (_chunks.Reader.TryRead(out var queued))
+                _pool.Return(queued.Chunk);
+        }
+
+        // The setup of the stream is reported with its first chunk, as a single job reports its own.
+        // In daemon mode the first chunk already carries it and Open reports none.
+        private static void AddSetup(ref LibComputeSample.ComputeStats stats, LibComputeSample.ComputeStats setup)
+        {
+            stats.SetupMs += setup.SetupMs;
+            stats.InstanceMs += setup.InstanceMs;
+            stats.DeviceMs += setup.DeviceMs;
+            stats.AllocationMs += setup.AllocationMs;
+            stats.PipelineMs += setup.PipelineMs;
+        }
+    }
+}
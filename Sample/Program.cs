@@ -2,11 +2,34 @@ using Sample;
 
 var builder = WebApplication.CreateBuilder(args);
 
+// SMA jobs run in this process unless "Compute:Mode" sends them to computesample-daemon.
+LibComputeSample.Configure(builder.Configuration.GetSection("Compute").Get<ComputeModeOptions>() ?? new ComputeModeOptions());
+
 // Add SMAIndicatorProcessor for dependency injection.
 // For now, this need to be a global object shared among other contexts
 // Due to the nature of Vulkan Implementation that could be improved upon
 // In the future, as this is only for demostrative purposes.
-builder.Services.AddSingleton<ISMAIndicatorProcessor>(new SMAIndicatorProcessor());
+var processor = new SMAIndicatorProcessor(builder.Configuration.GetSection("Streaming").Get<StreamingOptions>() ?? new StreamingOptions());
+builder.Services.AddSingleton<ISMAIndicatorProcessor>(processor);
+
+// Completed results are stored once here rather than by every controller instance,
+// which would subscribe again on each request.
+var resultCache = new ResultCache(builder.Configuration.GetSection("ResultCache").Get<ResultCacheOptions>() ?? new ResultCacheOptions());
+builder.Services.AddSingleton(resultCache);
+// Failed jobs are recorded so that their page stops waiting, a resubmission clears
+// the failure as its upload finishes and computes the key again.
+processor.FinishedStreamingUpload += (object? sender, StreamingJob job) => resultCache.ClearFailure(job.ResultKey!);
+processor.CompletedStreamingJob += (object? sender, StreamingJob job) => {
+    if (job.ResultKey is null)
+        return;
+    if (job.ResultPath is not null)
+        resultCache.AddFile(job.ResultKey, job.ResultPath);
+    else
+        resultCache.AddFailure(job.ResultKey);
+};
+
+// Stored series answering the chart window queries of APIController.Range.
+builder.Services.AddSingleton(new SeriesIndexCache(builder.Configuration.GetSection("Series").Get<SeriesOptions>() ?? new SeriesOptions()));
 
 // Add services to the container.
 builder.Services.AddControllersWithViews();